@@ -0,0 +1,176 @@
+#ifndef T_AC_TIMEBASE_HH
+#define T_AC_TIMEBASE_HH
+
+#include <limits>
+#include <string>
+#include <mha_plugin.hh>
+#include "timebase.hh"
+
+namespace t::plugins::timebase {
+
+    /** Data type of the AC variable <dll>_timebase: a
+     * t::timing::timebase_seqlock_t with num_entries 1 and stride
+     * sizeof(timebase_seqlock_t). */
+    static constexpr unsigned ac_data_type = MHA_AC_USER;
+
+    /** The time base of plugin dll as one AC variable <name>_timebase,
+     * written once per block.  Unlike the separate AC doubles _t0 and
+     * _t1, readers in other signal processing threads, e.g. in a parallel
+     * branch of the chain, always see the times of one and the same
+     * block. */
+    class publisher_t {
+    public:
+        /** Inserts the AC variable with an empty time base.
+         * @param ac AC variable space
+         * @param name full name of the AC variable */
+        publisher_t(algo_comm_t & ac, const std::string & name)
+            : ac(ac), name(name)
+        {
+            seqlock.reset();
+            ac.insert_var(name, {ac_data_type, 1U,
+                                 unsigned(sizeof(seqlock)), &seqlock});
+        }
+        publisher_t(const publisher_t &) = delete;
+        publisher_t & operator=(const publisher_t &) = delete;
+        ~publisher_t() {
+            try {
+                ac.remove_var(name);
+            } catch (...) {
+                // AC space is already gone
+            }
+        }
+
+        /** Publishes the time base of the current block.  Wait-free. */
+        void write(const t::timing::timebase_snapshot_t & s) {
+            seqlock.write(s);
+        }
+
+    private:
+        algo_comm_t & ac;
+        const std::string name;
+        t::timing::timebase_seqlock_t seqlock;
+    };
+
+    /** Start times of the blocks of a plugin that consumes the time base
+     * of plugin dll.  Counts its own blocks in samples of the dll, so that
+     * it does not matter whether the dll has already processed the
+     * current block when it runs in another thread: the latest consistent
+     * snapshot maps any sample index to a time.  The first block is
+     * assigned by time: when the reader runs later than half a period
+     * after the dll has processed the latest published block, its block
+     * is the next one, and again after the dll restarted.  Falls back to the AC doubles <dll>_t0 and
+     * <dll>_t1 for time sources without <dll>_timebase. */
+    class reader_t {
+    public:
+        /** @param ac AC variable space
+         * @param dll_name configured name of the dll plugin
+         * @param fragsize samples per block of the consuming plugin */
+        reader_t(algo_comm_t & ac, const std::string & dll_name,
+                 unsigned fragsize)
+            : ac(ac)
+            , timebase_name(dll_name + "_timebase")
+            , t0_name(dll_name + "_t0")
+            , t1_name(dll_name + "_t1")
+            , fragsize(fragsize)
+        {}
+
+        /** Reads the time base for the next block.  Wait-free, call once
+         * per block.
+         * @param t0 start time of the block / s, NaN when unknown
+         * @param dt time between two samples of the block / s */
+        void next_block(double & t0, double & dt) {
+            const t::timing::timebase_seqlock_t * seqlock = find_seqlock();
+            if (seqlock == nullptr) {
+                t0 = get_ac(t0_name);
+                dt = (get_ac(t1_name) - t0) / fragsize;
+                return;
+            }
+            // On failure the previous snapshot is extrapolated
+            seqlock->read(snapshot);
+            if (snapshot.n1 == 0U) {
+                synchronized = false;
+                t0 = dt = std::numeric_limits<double>::quiet_NaN();
+                return;
+            }
+            if (synchronized)
+                n0 += fragsize;
+            // A restarted dll counts from 0 again, a new one also restarts
+            // the sequence
+            const uint64_t dll_fragsize = snapshot.n1 - snapshot.n0;
+            if (!synchronized || snapshot.n1 + dll_fragsize < n0 ||
+                int32_t(snapshot.sequence - sequence) < 0)
+                n0 = first_block();
+            sequence = snapshot.sequence;
+            // The dll cannot be ahead of our block, we were behind
+            if (snapshot.n0 > n0)
+                n0 = snapshot.n0;
+            synchronized = true;
+            t0 = snapshot.time_of(n0);
+            dt = snapshot.period / dll_fragsize;
+        }
+
+        /** Reads the latest snapshot of the dll without assigning a
+         * block, for consumers that map between the sample indices of
+         * several streams.  Wait-free.
+         * @param s latest consistent snapshot
+         * @return false if the dll publishes no <dll>_timebase or nothing
+         *         was published yet; s is unchanged then */
+        bool latest(t::timing::timebase_snapshot_t & s) {
+            const t::timing::timebase_seqlock_t * seqlock = find_seqlock();
+            if (seqlock == nullptr)
+                return false;
+            // On failure the previous snapshot is returned
+            seqlock->read(snapshot);
+            if (snapshot.n1 == 0U)
+                return false;
+            s = snapshot;
+            return true;
+        }
+
+    private:
+        /** @return first sample index of the block of the first call */
+        uint64_t first_block() const {
+            const double processed = snapshot.t0 - snapshot.adjustment;
+            if (snapshot.now() >= processed + 0.5 * snapshot.period)
+                return snapshot.n1;
+            return snapshot.n0;
+        }
+        const t::timing::timebase_seqlock_t * find_seqlock() const {
+            if (ac.is_var(timebase_name) == false)
+                return nullptr;
+            comm_var_t cv = ac.get_var(timebase_name);
+            if (cv.data_type != ac_data_type || cv.num_entries != 1 ||
+                cv.stride != sizeof(t::timing::timebase_seqlock_t) ||
+                cv.data == nullptr)
+                return nullptr;
+            return static_cast<const t::timing::timebase_seqlock_t*>(cv.data);
+        }
+        double get_ac(const std::string & name) const {
+            if (ac.is_var(name) == false)
+                return std::numeric_limits<double>::quiet_NaN();
+            comm_var_t cv = ac.get_var(name);
+            if (cv.data_type != MHA_AC_DOUBLE || cv.num_entries != 1 ||
+                cv.data == nullptr)
+                return std::numeric_limits<double>::quiet_NaN();
+            return *static_cast<const double*>(cv.data);
+        }
+
+        algo_comm_t & ac;
+        const std::string timebase_name, t0_name, t1_name;
+        const unsigned fragsize;
+        t::timing::timebase_snapshot_t snapshot;
+        uint64_t n0 = {0U};
+        /** Sequence of the latest snapshot */
+        uint32_t sequence = {0U};
+        bool synchronized = {false};
+    };
+}
+
+#endif
+
+// Local variables:
+// compile-command: "make"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include <mha_plugin.hh>
+
+namespace t::plugins::bands {
+
+    /** Energies of frequency bands of the STFT frame of each channel: the
+     * sums of the squared magnitudes of the bins whose center frequencies
+     * lie in [edge_b, edge_b+1).  Each sum runs over the real and
+     * imaginary parts of the bins as one contiguous float array and is
+     * vectorized.  Never allocates after construction. */
+    class band_energies_t {
+        static_assert(sizeof(mha_complex_t) == 2 * sizeof(mha_real_t),
+                      "bins are summed as one array of real numbers");
+    public:
+        /** Constructor
+         * @param d channels, fftlen, srate
+         * @param edges ascending band edges / Hz, one more than bands
+         * @throw MHA_Error if there is no band, edges are not ascending or
+         *        above the Nyquist frequency */
+        band_energies_t(const mhaconfig_t & d, const std::vector<float> & edges)
+            : bands(check(edges, d.srate))
+            , channels(d.channels)
+            , energies(size_t(bands) * d.channels, 0.0f)
+        {
+            const unsigned bins = d.fftlen / 2U + 1U;
+            for (float edge : edges)
+                first_bins.push_back
+                    (std::min(bins, unsigned(std::ceil(double(edge) *
+                                                       d.fftlen / d.srate))));
+        }
+
+        const unsigned bands;
+        const unsigned channels;
+        /** Energies of the latest frame, band index running fastest */
+        std::vector<float> energies;
+        /** First bin of each band and the end of the last band */
+        std::vector<unsigned> first_bins;
+
+        /** Computes the band energies of one STFT frame.
+         * @return energies */
+        const std::vector<float> & process(const mha_spec_t & s) {
+            for (unsigned ch = 0; ch < channels; ++ch) {
+                const mha_real_t * bins = &s.buf[size_t(ch)*s.num_frames].re;
+                for (unsigned band = 0; band < bands; ++band)
+                    energies[ch * bands + band] =
+                        sum_of_squares(bins + 2U * first_bins[band],
+                                       2U * (first_bins[band + 1U] -
+                                             first_bins[band]));
+            }
+            return energies;
+        }
+
+        /** @return sum of the squares of n numbers starting at x */
+        static float sum_of_squares(const mha_real_t * x, unsigned n) {
+            float sum = 0.0f;
+#pragma omp simd reduction(+:sum)
+            for (unsigned k = 0; k < n; ++k)
+                sum += x[k] * x[k];
+            return sum;
+        }
+
+        /** @return edges of the octave bands with center frequencies from
+         * 125 Hz to 8 kHz that lie below the Nyquist frequency */
+        static std::vector<float> octave_edges(float srate) {
+            std::vector<float> edges;
+            for (int octave = 0; octave <= 7; ++octave) {
+                const float edge = 125.0f * std::exp2(octave - 0.5f);
+                if (edge <= srate / 2)
+                    edges.push_back(edge);
+            }
+            return edges;
+        }
+
+    private:
+        static unsigned check(const std::vector<float> & edges, float srate) {
+            if (edges.size() < 2U)
+                throw MHA_Error(__FILE__, __LINE__, "band edges need at"
+                                " least two frequencies, got %zu",
+                                edges.size());
+            for (size_t k = 0; k < edges.size(); ++k)
+                if (!(edges[k] >= 0.0f) ||
+                    (k > 0U && !(edges[k] > edges[k - 1U])))
+                    throw MHA_Error(__FILE__, __LINE__, "band edges are not"
+                                    " ascending non-negative frequencies at"
+                                    " index %zu", k);
+            if (edges.back() > srate / 2)
+                throw MHA_Error(__FILE__, __LINE__, "band edge %g Hz is above"
+                                " the Nyquist frequency %g Hz",
+                                edges.back(), srate / 2);
+            return edges.size() - 1U;
+        }
+    };
+
+    /** Averages the band energies of consecutive frames and their time
+     * stamps.  Never allocates after construction. */
+    class band_average_t {
+    public:
+        /** @param size number of energies per frame
+         * @param frames number of frames averaged */
+        band_average_t(size_t size, unsigned frames)
+            : frames(frames), sum(size, 0.0f), mean(size, 0.0f)
+        {}
+
+        const unsigned frames;
+        /** Sums of the frames added since the latest mean */
+        std::vector<float> sum;
+        /** Mean energies of the latest frames frames */
+        std::vector<float> mean;
+        /** Mean time stamp of the latest frames frames */
+        double time = {0.0};
+
+        /** Adds the energies of one frame.
+         * @return true when frames frames were added, mean and time are
+         *         updated then */
+        bool add(const std::vector<float> & energies, double frame_time) {
+            for (size_t k = 0; k < sum.size(); ++k)
+                sum[k] += energies[k];
+            time_sum += frame_time;
+            if (++count < frames)
+                return false;
+            for (size_t k = 0; k < sum.size(); ++k) {
+                mean[k] = sum[k] / frames;
+                sum[k] = 0.0f;
+            }
+            time = time_sum / frames;
+            time_sum = 0.0;
+            count = 0U;
+            return true;
+        }
+
+    private:
+        unsigned count = {0U};
+        double time_sum = {0.0};
+    };
+}
+
+// Local variables:
+// compile-command: "make"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
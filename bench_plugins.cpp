@@ -0,0 +1,151 @@
+// Micro-benchmarks of the process() callbacks of the plugins in this
+// repository.  Each benchmark loads the plugin under test, together with
+// the plugins it depends on, into one AC space, prepares them with the
+// swept signal dimensions and measures the duration of every single
+// process() callback of the plugin under test.  Median and 99th percentile
+// of the per-block durations are reported as counters median_ns and p99_ns.
+//
+// Run with "make bench".  The plugins are loaded from the current directory.
+
+#include <benchmark/benchmark.h>
+#include <mha_algo_comm.hh>
+#include <mha_signal.hh>
+#include <mhapluginloader.h>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <time.h>
+
+namespace {
+    /** One plugin to load: plugin name and configuration commands */
+    struct plugin_setup_t {
+        std::string name;
+        std::vector<std::string> commands;
+    };
+
+    /** Plugins sharing one AC space.  The last plugin is the plugin under
+     * test, the preceding plugins provide its input, e.g. the dll times. */
+    class chain_t {
+    public:
+        chain_t(const std::vector<plugin_setup_t> & setups,
+                mhaconfig_t signal_dimensions)
+            : input(signal_dimensions.fragsize, signal_dimensions.channels)
+        {
+            std::mt19937 generator(0);
+            std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+            for (unsigned k = 0; k < input.get_size(); ++k)
+                input.buf[k] = noise(generator);
+            for (const plugin_setup_t & setup : setups) {
+                plugins.push_back(std::make_unique
+                                  <PluginLoader::mhapluginloader_t>
+                                  (algo_comm.get_c_handle(), setup.name));
+                for (const std::string & command : setup.commands)
+                    plugins.back()->parse(command);
+                mhaconfig_t cf = signal_dimensions;
+                plugins.back()->prepare(cf);
+            }
+        }
+        ~chain_t() {
+            for (auto plugin = plugins.rbegin(); plugin != plugins.rend();
+                 ++plugin)
+                (*plugin)->release();
+            plugins.clear();
+        }
+        /** Process one block with all plugins.
+         * @return duration of the last plugin's process() in ns */
+        double process() {
+            mha_wave_t * s = &input;
+            for (size_t index = 0; index + 1 < plugins.size(); ++index)
+                plugins[index]->process(s, &s);
+            struct timespec start, stop;
+            clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+            plugins.back()->process(s, &s);
+            clock_gettime(CLOCK_MONOTONIC_RAW, &stop);
+            return (stop.tv_sec - start.tv_sec) * 1e9
+                + (stop.tv_nsec - start.tv_nsec);
+        }
+    private:
+        MHAKernel::algo_comm_class_t algo_comm;
+        std::vector<std::unique_ptr<PluginLoader::mhapluginloader_t>> plugins;
+        MHASignal::waveform_t input;
+    };
+
+    /** Benchmark body shared by all plugins.  Arguments of the benchmark
+     * are fragsize, number of channels, and sampling rate. */
+    void bench_process(benchmark::State & state,
+                       std::vector<plugin_setup_t> setups) {
+        const mhaconfig_t signal_dimensions =
+            {.channels=unsigned(state.range(1)), .domain=MHA_WAVEFORM,
+             .fragsize=unsigned(state.range(0)),
+             .wndlen=unsigned(2*state.range(0)),
+             .fftlen=unsigned(4*state.range(0)),
+             .srate=float(state.range(2))};
+        chain_t chain(setups, signal_dimensions);
+        // per-block durations, only the first ones are kept for statistics
+        std::vector<double> durations;
+        durations.reserve(100000U);
+        for (auto _ : state) {
+            double duration = chain.process();
+            if (durations.size() < durations.capacity())
+                durations.push_back(duration);
+        }
+        if (durations.empty())
+            return;
+        auto percentile = [&](double p) {
+            auto nth = durations.begin() + size_t(p * (durations.size()-1));
+            std::nth_element(durations.begin(), nth, durations.end());
+            return *nth;
+        };
+        state.counters["median_ns"] = percentile(0.5);
+        state.counters["p99_ns"] = percentile(0.99);
+    }
+
+    /** Sweep of fragsize, channel count and sampling rate */
+    void sweep(benchmark::internal::Benchmark * b) {
+        b->ArgNames({"fragsize", "channels", "srate"});
+        b->ArgsProduct({{32, 96, 256, 1024}, {1, 2, 8}, {16000, 44100, 48000}});
+    }
+
+    const plugin_setup_t dll = {"dll", {}};
+}
+
+BENCHMARK_CAPTURE(bench_process, dll,
+                  std::vector<plugin_setup_t>{dll})->Apply(sweep);
+BENCHMARK_CAPTURE(bench_process, timestamper,
+                  std::vector<plugin_setup_t>{{"timestamper", {}}})
+->Apply(sweep);
+BENCHMARK_CAPTURE(bench_process, metronome,
+                  std::vector<plugin_setup_t>
+                  {dll, {"metronome", {"bpm=240"}}})->Apply(sweep);
+BENCHMARK_CAPTURE(bench_process, syncmeter,
+                  std::vector<plugin_setup_t>{{"syncmeter", {}}})
+->Apply(sweep);
+BENCHMARK_CAPTURE(bench_process, latency,
+                  std::vector<plugin_setup_t>
+                  {{"latency", {"interval=0.05", "max_latency=0.04"}}})
+->Apply(sweep);
+BENCHMARK_CAPTURE(bench_process, wav2lsl,
+                  std::vector<plugin_setup_t>
+                  {dll, {"wav2lsl", {"stream_name=bench_wav2lsl"}}})
+->Apply(sweep);
+BENCHMARK_CAPTURE(bench_process, lsl2wav,
+                  std::vector<plugin_setup_t>
+                  {dll, {"wav2lsl", {"stream_name=bench_lsl2wav"}},
+                   {"lsl2wav", {"stream_name=bench_lsl2wav"}}})->Apply(sweep);
+BENCHMARK_CAPTURE(bench_process, wav2shm,
+                  std::vector<plugin_setup_t>
+                  {dll, {"wav2shm", {"shm_name=/bench_wav2shm"}}})
+->Apply(sweep);
+BENCHMARK_CAPTURE(bench_process, shm2wav,
+                  std::vector<plugin_setup_t>
+                  {dll, {"wav2shm", {"shm_name=/bench_shm2wav"}},
+                   {"shm2wav", {"shm_name=/bench_shm2wav"}}})->Apply(sweep);
+
+BENCHMARK_MAIN();
+
+// Local variables:
+// compile-command: "make bench"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
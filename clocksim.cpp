@@ -0,0 +1,159 @@
+// Sweeps the dll over bandwidths, fragsizes and the noise models of
+// clocksim.hh on all CPU cores and prints accuracy and settling tables.
+//
+// Usage:
+//   ./clocksim [estimator=dll] [prefilter=none] [clip=0] [dual=0]
+//              [auto=0] [duration=60] [threads=<number of cores>]
+// With auto=1, the bandwidth is tuned within 0.02..2 Hz starting at the
+// bandwidth of the table row, the column "tuned" shows the final bandwidth.
+
+#include "clocksim.hh"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <vector>
+
+namespace sim = t::timing::sim;
+
+namespace {
+    /** Noise models of the sweep */
+    std::vector<sim::model_t> models(double duration)
+    {
+        std::vector<sim::model_t> m(8);
+        m[0].name = "clean";
+        m[1].name = "jitter";
+        m[1].jitter = 50e-6;
+        m[2].name = "quantized";     // like sample_data/bpi-r48-p96.mat
+        m[2].quantum = 158.31e-6;
+        m[2].jitter = 5e-6;
+        m[3].name = "drift";         // warming crystal
+        m[3].drift_ppm_per_s = 0.05;
+        m[3].jitter = 20e-6;
+        m[4].name = "xruns";
+        m[4].xrun_interval = 10.0;
+        m[4].jitter = 20e-6;
+        m[5].name = "ntp-steps";
+        m[5].step_interval = 20.0;
+        m[5].step = 1e-3;
+        m[5].jitter = 20e-6;
+        m[6].name = "overload";      // long and variable callback delays
+        m[6].jitter = 300e-6;
+        m[7].name = "wander";        // crystal without temperature control
+        m[7].wander_ppm = 1.0;
+        m[7].jitter = 2e-6;
+        for (sim::model_t & model : m)
+            model.duration = duration;
+        return m;
+    }
+
+    const double bandwidths[] = {0.05, 0.1, 0.2, 0.5, 1.0, 2.0, 5.0};
+    const unsigned fragsizes[] = {32U, 96U, 256U, 1024U};
+
+    struct job_t {
+        sim::model_t model;
+        sim::loop_t loop;
+        sim::result_t result;
+    };
+
+    /** Prints a table cell, '-' for infinite or undefined values */
+    void print(double value) {
+        if (std::isfinite(value))
+            std::printf(" %10.2f", value);
+        else
+            std::printf(" %10s", "-");
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    std::map<std::string, std::string> args = {
+        {"estimator", "dll"}, {"prefilter", "none"}, {"clip", "0"},
+        {"dual", "0"}, {"auto", "0"}, {"duration", "60"},
+        {"threads", std::to_string(std::max(1U,
+                                   std::thread::hardware_concurrency()))}};
+    for (int i = 1; i < argc; ++i) {
+        const char * separator = std::strchr(argv[i], '=');
+        const std::string key =
+            separator ? std::string(argv[i], separator - argv[i]) : "";
+        if (args.count(key) == 0U) {
+            std::fprintf(stderr, "usage: %s [estimator=dll] [prefilter=none]"
+                         " [clip=0] [dual=0] [auto=0] [duration=60]"
+                         " [threads=N]\n", argv[0]);
+            return 1;
+        }
+        args[key] = separator + 1;
+    }
+
+    std::vector<job_t> jobs;
+    for (const sim::model_t & model :
+             models(std::atof(args["duration"].c_str())))
+        for (unsigned fragsize : fragsizes)
+            for (double bandwidth : bandwidths) {
+                job_t job;
+                job.model = model;
+                job.loop.fragsize = fragsize;
+                job.loop.bandwidth = bandwidth;
+                job.loop.estimator = args["estimator"];
+                job.loop.prefilter = args["prefilter"];
+                job.loop.outlier_clip = std::atof(args["clip"].c_str());
+                job.loop.dual_clock = std::atoi(args["dual"].c_str()) != 0;
+                job.loop.auto_bandwidth =
+                    std::atoi(args["auto"].c_str()) != 0;
+                jobs.push_back(job);
+            }
+
+    // Every thread takes the next job until all are done.  Results go into
+    // the job, so the output does not depend on the scheduling.
+    std::atomic<size_t> next = {0U};
+    std::vector<std::thread> threads;
+    const unsigned thread_count = std::max(1, std::atoi(args["threads"].c_str()));
+    for (unsigned i = 0; i < thread_count; ++i)
+        threads.emplace_back([&]() {
+            for (size_t j; (j = next++) < jobs.size();)
+                jobs[j].result = sim::simulate(jobs[j].model, jobs[j].loop);
+        });
+    for (std::thread & thread : threads)
+        thread.join();
+
+    const bool tuned = std::atoi(args["auto"].c_str()) != 0;
+    std::printf("estimator %s, prefilter %s, clip %s, dual clock %s,"
+                " auto bandwidth %s, %s s per run, %u threads\n",
+                args["estimator"].c_str(), args["prefilter"].c_str(),
+                args["clip"].c_str(), args["dual"].c_str(),
+                args["auto"].c_str(), args["duration"].c_str(),
+                thread_count);
+    std::printf("settled: deviation without noise below %g us until the"
+                " next disturbance, '-': never settled\n",
+                sim::loop_t().tolerance * 1e6);
+    std::string model;
+    for (const job_t & job : jobs) {
+        if (job.model.name != model) {
+            model = job.model.name;
+            std::printf("\n%s\n%8s %8s", model.c_str(), "fragsize", "B/Hz");
+            if (tuned)
+                std::printf(" %10s", "tuned/Hz");
+            std::printf(" %10s %10s %10s %10s\n", "rms/us", "max/us",
+                        "settle/s", "recover/s");
+        }
+        std::printf("%8u %8g", job.loop.fragsize, job.loop.bandwidth);
+        if (tuned)
+            print(job.result.bandwidth);
+        print(job.result.rms * 1e6);
+        print(job.result.max * 1e6);
+        print(job.result.settle);
+        if (job.result.disturbances)
+            print(job.result.recovery);
+        std::printf("\n");
+    }
+    return 0;
+}
+
+// Local variables:
+// compile-command: "make clocksim"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
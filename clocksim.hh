@@ -0,0 +1,263 @@
+// Synthetic timestamp streams for tuning and testing the dll without
+// recording real hardware.  A model_t describes the sound card clock and
+// the disturbances of the measured callback times, run() feeds the
+// generated times through timing::dll_t and compares the filtered times with
+// the true block start times, simulate() condenses this into accuracy and
+// settling figures.  Used by the clocksim sweep tool and by
+// dll_unit_tests.cpp.  Deterministic for a given seed.
+
+#include "timing.hh"
+#include <string>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace t::timing::sim {
+
+    /** Sound card clock and measurement disturbances */
+    struct model_t {
+        /** Name shown in the result tables */
+        std::string name = "clean";
+
+        /** Nominal sampling rate / Hz */
+        double srate = 48000.0;
+
+        /** Frequency error of the sound card crystal / ppm */
+        double offset_ppm = 30.0;
+
+        /** Change of the frequency error over time / (ppm/s) */
+        double drift_ppm_per_s = 0.0;
+
+        /** Random walk of the frequency error, e.g. by temperature
+         * fluctuations, standard deviation after 1 s / ppm */
+        double wander_ppm = 0.0;
+
+        /** Mean scheduling delay of the callbacks, exponentially
+         * distributed / s */
+        double jitter = 0.0;
+
+        /** Grid of the callback times, e.g. the 158.31 us of
+         * sample_data/non-random.md, 0: none / s */
+        double quantum = 0.0;
+
+        /** Interval between xruns, 0: none / s */
+        double xrun_interval = 0.0;
+
+        /** Blocks lost by each xrun */
+        unsigned xrun_blocks = 2U;
+
+        /** Interval between steps of the system clock, 0: none / s */
+        double step_interval = 0.0;
+
+        /** Size of each system clock step / s */
+        double step = 0.0;
+
+        /** System time of the first block, absolute times exercise the
+         * precision handling of the estimators / s */
+        double start = 1.7e9;
+
+        /** Simulated duration / s */
+        double duration = 60.0;
+
+        /** Seed of the random generator */
+        uint64_t seed = 1U;
+    };
+
+    /** Configuration of the simulated dll */
+    struct loop_t {
+        unsigned fragsize = 96U;
+        double bandwidth = 0.2;
+        std::string estimator = "dll";
+        std::string prefilter = "none";
+        double outlier_clip = 0.0;
+
+        /** Tune the bandwidth within these bounds, starting at bandwidth */
+        bool auto_bandwidth = false;
+        double bandwidth_min = 0.02;
+        double bandwidth_max = 2.0;
+
+        /** Run the loop on a clock without steps and map onto the stepped
+         * clock with the offset filter, see "Dual clock mode" in README */
+        bool dual_clock = false;
+
+        /** The loop has settled when the filtered times of the noise-free
+         * model deviate less than this from the true times until the next
+         * disturbance / s */
+        double tolerance = 1e-6;
+    };
+
+    struct result_t {
+        /** Deviation of the filtered times from the true times after the
+         * loop has settled */
+        double rms = std::numeric_limits<double>::quiet_NaN();
+        double max = std::numeric_limits<double>::quiet_NaN();
+
+        /** Time from the first block until settled, infinity if the loop
+         * did not settle before the first disturbance / s */
+        double settle = std::numeric_limits<double>::infinity();
+
+        /** Longest time to settle again after an xrun or clock step,
+         * 0 without disturbances / s */
+        double recovery = 0.0;
+
+        /** Number of xruns and clock steps */
+        unsigned disturbances = 0U;
+
+        /** Bandwidth at the end of the noisy run / Hz */
+        double bandwidth = std::numeric_limits<double>::quiet_NaN();
+    };
+
+    /** Deviations of the filtered times from the true times */
+    struct run_t {
+        std::vector<double> deviation;
+
+        /** First block of each segment between disturbances, followed by
+         * the number of blocks */
+        std::vector<uint64_t> segments = {0U};
+
+        /** Nominal block duration / s */
+        double tper;
+
+        /** Bandwidth of the loop at the end / Hz */
+        double bandwidth;
+    };
+
+    /** Feeds the callback times of the model through the loop.  The true
+     * time of a block is its start time on the sound card clock,
+     * expressed in the (stepped) system clock, plus the mean scheduling
+     * delay: a constant latency is not visible in the callback times and
+     * is corrected with the adjustment parameter of the dll. */
+    inline run_t run(const model_t & model, const loop_t & loop)
+    {
+        ttiming_params_t params;
+        ttiming_default_params(&params, model.srate, loop.fragsize);
+        params.bandwidth = loop.bandwidth;
+        params.clock_source = "CLOCK_MONOTONIC";
+        params.offset_clock = loop.dual_clock ? "CLOCK_REALTIME" : "none";
+        params.estimator = loop.estimator.c_str();
+        params.prefilter = loop.prefilter.c_str();
+        params.outlier_clip = loop.outlier_clip;
+        params.auto_bandwidth = loop.auto_bandwidth;
+        params.bandwidth_min = loop.bandwidth_min;
+        params.bandwidth_max = loop.bandwidth_max;
+        dll_t dll(params);
+        // Random numbers computed from the raw output of the generator:
+        // the distributions of <random> differ between standard libraries,
+        // the unit tests need the same numbers everywhere
+        std::mt19937_64 random(model.seed);
+        auto uniform = [&]() {return (random() >> 11) * 0x1p-53;};
+        auto delay = [&]() {return -std::log1p(-uniform()) * model.jitter;};
+        auto gaussian = [&]() {
+            return std::sqrt(-2 * std::log1p(-uniform())) *
+                std::cos(2 * M_PI * uniform());
+        };
+        const double wander_per_block = model.wander_ppm * std::sqrt(dll.tper);
+        double wander = 0.0;
+        const uint64_t blocks = uint64_t(model.duration / dll.tper);
+        run_t result;
+        result.tper = dll.tper;
+        result.deviation.resize(blocks);
+
+        // Periodic disturbances, none in the last half interval, which
+        // would be too short to observe the recovery
+        auto after = [&](double time, double interval) {
+            return interval > 0 && time + interval <=
+                model.duration - interval / 2 ?
+                time + interval : std::numeric_limits<double>::infinity();
+        };
+        double next_xrun = after(0.0, model.xrun_interval);
+        double next_step = after(0.0, model.step_interval);
+        // Sound card time relative to start, in the unstepped system clock
+        double elapsed = 0.0;
+        // Accumulated system clock steps
+        double stepped = 0.0;
+        for (uint64_t k = 0; k < blocks; ++k) {
+            if (elapsed >= next_xrun) {
+                elapsed += model.xrun_blocks * dll.tper;
+                next_xrun = after(next_xrun, model.xrun_interval);
+                result.segments.push_back(k);
+            }
+            if (elapsed >= next_step) {
+                stepped += model.step;
+                next_step = after(next_step, model.step_interval);
+                if (result.segments.back() != k)
+                    result.segments.push_back(k);
+            }
+            // Callback time relative to start, in the unstepped clock
+            double measured = elapsed;
+            if (model.jitter > 0)
+                measured += delay() - model.jitter;
+            if (model.quantum > 0)
+                measured = std::round(measured / model.quantum) *
+                    model.quantum;
+            double filtered;
+            if (loop.dual_clock) {
+                filtered = dll.filter_time(model.start + measured);
+                filtered += dll.filter_offset(stepped);
+            } else
+                filtered = dll.filter_time(model.start + stepped + measured);
+            result.deviation[k] = filtered - (model.start + stepped + elapsed);
+
+            if (model.wander_ppm > 0)
+                wander += wander_per_block * gaussian();
+            const double ppm = model.offset_ppm +
+                model.drift_ppm_per_s * elapsed + wander;
+            elapsed += dll.tper / (1 + ppm * 1e-6);
+        }
+        result.segments.push_back(blocks);
+        result.bandwidth = dll.bandwidth();
+        return result;
+    }
+
+    /** Simulates the loop on the model.  Settling and recovery times are
+     * taken from a second run without jitter, quantization and wander,
+     * where the transients are not hidden by noise.  Accuracy is measured
+     * on the noisy run in the settled blocks. */
+    inline result_t simulate(const model_t & model, const loop_t & loop)
+    {
+        model_t noise_free = model;
+        noise_free.jitter = noise_free.quantum = noise_free.wander_ppm = 0.0;
+        const run_t transient = run(noise_free, loop);
+        const run_t noisy = run(model, loop);
+        const std::vector<uint64_t> & segments = transient.segments;
+
+        result_t result;
+        result.disturbances = segments.size() - 2U;
+        result.bandwidth = noisy.bandwidth;
+        double sum2 = 0.0, max = 0.0;
+        uint64_t count = 0U;
+        for (size_t s = 0; s + 1U < segments.size(); ++s) {
+            const uint64_t begin = segments[s], end = segments[s + 1U];
+            uint64_t settled = end;
+            while (settled > begin &&
+                   std::fabs(transient.deviation[settled - 1U]) <
+                   loop.tolerance)
+                --settled;
+            const double time = settled == end ?
+                std::numeric_limits<double>::infinity() :
+                (settled - begin) * transient.tper;
+            if (s == 0U)
+                result.settle = time;
+            else
+                result.recovery = std::max(result.recovery, time);
+            for (uint64_t k = settled; k < end; ++k) {
+                sum2 += noisy.deviation[k] * noisy.deviation[k];
+                max = std::max(max, std::fabs(noisy.deviation[k]));
+            }
+            count += end - settled;
+        }
+        if (count) {
+            result.rms = std::sqrt(sum2 / count);
+            result.max = max;
+        }
+        return result;
+    }
+}
+
+// Local variables:
+// compile-command: "make clocksim"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
@@ -1,69 +1,85 @@
-#include <time.h>
 #include "dll.hh"
+#include "trace.hh"
+#include <stdexcept>
 
 namespace dll = t::plugins::dll;
 
-dll::cfg_t::cfg_t(const mhaconfig_t & signal_dimensions,
-                  const double bandwidth,
-                  const std::string & clock_source_name,
-                  const double adjustment)
-    : F(double(signal_dimensions.srate) / signal_dimensions.fragsize)
-    , B(bandwidth)
-    , b(sqrt(8) * M_PI * B / F)
-    , c(b*b/2)
-    , nper(signal_dimensions.fragsize)
-    , tper(signal_dimensions.fragsize / double(signal_dimensions.srate))
-    , adjustment(adjustment)
-{
-#define checkassignclocksource(whichclock) \
-    if (clock_source_name == #whichclock)  \
-        clock_source = whichclock;
-    checkassignclocksource(CLOCK_REALTIME);
-    checkassignclocksource(CLOCK_REALTIME_COARSE);
-    checkassignclocksource(CLOCK_MONOTONIC);
-    checkassignclocksource(CLOCK_MONOTONIC_COARSE);
-    checkassignclocksource(CLOCK_MONOTONIC_RAW);
-    checkassignclocksource(CLOCK_BOOTTIME);
-    checkassignclocksource(CLOCK_PROCESS_CPUTIME_ID);
-    checkassignclocksource(CLOCK_THREAD_CPUTIME_ID);
-}
-
-std::pair<double,double> dll::cfg_t::process()
-{
-    struct timespec timespec = {.tv_sec = 0, .tv_nsec = 0};
-    double unfiltered_time = std::numeric_limits<double>::quiet_NaN();
-    if (clock_gettime(clock_source, &timespec) == 0)
-        unfiltered_time = timespec.tv_sec + timespec.tv_nsec * 1e-9;
-    filter_time(unfiltered_time);
-    return {t0+adjustment, t1+adjustment};
-}
+namespace {
+    /** @return the value of the double AC variable name, 0 if name is
+     * empty or the variable is missing, of another type or not finite */
+    double ac_adjustment(algo_comm_t & ac, const std::string & name)
+    {
+        if (name.empty() || !ac.is_var(name))
+            return 0.0;
+        comm_var_t cv = ac.get_var(name);
+        if (cv.data_type != MHA_AC_DOUBLE || cv.num_entries != 1 ||
+            cv.data == nullptr)
+            return 0.0;
+        const double value = *static_cast<const double *>(cv.data);
+        return std::isfinite(value) ? value : 0.0;
+    }
 
-double dll::cfg_t::filter_time(double unfiltered_time)
-{
-    if (n1 == 0U)
-        return dll_init(unfiltered_time);
-    return dll_update(unfiltered_time);
+    /** @return the parameters of the timing core */
+    ttiming_params_t params(const mhaconfig_t & signal_dimensions,
+                            const double bandwidth,
+                            const std::string & clock_source_name,
+                            const double adjustment,
+                            const std::string & offset_clock_name,
+                            const double offset_bandwidth,
+                            const double step_threshold,
+                            const std::string & estimator_name,
+                            const std::string & prefilter_name,
+                            const double outlier_clip,
+                            const bool auto_bandwidth,
+                            const double bandwidth_min,
+                            const double bandwidth_max,
+                            const double tuning_time)
+    {
+        ttiming_params_t params;
+        ttiming_default_params(&params, signal_dimensions.srate,
+                               signal_dimensions.fragsize);
+        params.bandwidth = bandwidth;
+        params.clock_source = clock_source_name.c_str();
+        params.adjustment = adjustment;
+        params.offset_clock = offset_clock_name.c_str();
+        params.offset_bandwidth = offset_bandwidth;
+        params.step_threshold = step_threshold;
+        params.estimator = estimator_name.c_str();
+        params.prefilter = prefilter_name.c_str();
+        params.outlier_clip = outlier_clip;
+        params.auto_bandwidth = auto_bandwidth;
+        params.bandwidth_min = bandwidth_min;
+        params.bandwidth_max = bandwidth_max;
+        params.tuning_time = tuning_time;
+        return params;
+    }
 }
 
-double dll::cfg_t::dll_init(double unfiltered_time)
+dll::cfg_t::cfg_t(const mhaconfig_t & signal_dimensions,
+                  const double bandwidth,
+                  const std::string & clock_source_name,
+                  const double adjustment,
+                  const std::string & offset_clock_name,
+                  const double offset_bandwidth,
+                  const double step_threshold,
+                  const std::string & estimator_name,
+                  const std::string & prefilter_name,
+                  const double outlier_clip,
+                  const bool auto_bandwidth,
+                  const double bandwidth_min,
+                  const double bandwidth_max,
+                  const double tuning_time,
+                  const std::string & adjustment_source)
+try : t::timing::dll_t(params(signal_dimensions, bandwidth, clock_source_name,
+                              adjustment, offset_clock_name, offset_bandwidth,
+                              step_threshold, estimator_name, prefilter_name,
+                              outlier_clip, auto_bandwidth, bandwidth_min,
+                              bandwidth_max, tuning_time))
+    , adjustment_source(adjustment_source)
 {
-    e2 = tper;
-    t0 = unfiltered_time;
-    t1 = t0 + e2;
-    n0 = 0;
-    n1 = nper;
-    return t0;
 }
-
-double dll::cfg_t::dll_update(double unfiltered_time)
-{
-    e = unfiltered_time - t1;
-    t0 = t1;
-    t1 += b*e + e2;
-    e2 += c*e;
-    n0 = n1;
-    n1 += nper;
-    return t0;
+catch (const std::exception & e) {
+    throw MHA_Error(__FILE__, __LINE__, "%s", e.what());
 }
 
 dll::if_t::if_t(algo_comm_t & algo_comm,
@@ -74,48 +90,139 @@ dll::if_t::if_t(algo_comm_t & algo_comm,
                                  configured_name + "_t0 and " +
                                  configured_name + "_t1 (filtered start"
                                  " times of current and next buffers in"
-                                 " seconds)",
+                                 " seconds), and " + configured_name +
+                                 "_n0 and " + configured_name + "_n1"
+                                 " (total sample indices of the first"
+                                 " samples of current and next buffers),"
+                                 " and " + configured_name + "_bandwidth"
+                                 " (bandwidth of the filter in Hz), and all"
+                                 " of these for one block as seqlock " +
+                                 configured_name + "_timebase, see"
+                                 " ac_timebase.hh",
                                  algo_comm)
     , filtered_time_t0(algo_comm, configured_name + "_t0",
                        std::numeric_limits<double>::quiet_NaN())
     , filtered_time_t1(algo_comm, configured_name + "_t1",
                        std::numeric_limits<double>::quiet_NaN())
+    , sample_index_n0(algo_comm, configured_name + "_n0",
+                      std::numeric_limits<double>::quiet_NaN())
+    , sample_index_n1(algo_comm, configured_name + "_n1",
+                      std::numeric_limits<double>::quiet_NaN())
+    , current_bandwidth(algo_comm, configured_name + "_bandwidth",
+                        std::numeric_limits<double>::quiet_NaN())
+    , published_timebase(algo_comm, configured_name + "_timebase")
 {
     insert_member(bandwidth);
     patchbay.connect(&bandwidth.writeaccess, this, &if_t::update);
     insert_member(clock_source);
     patchbay.connect(&clock_source.writeaccess, this, &if_t::update);
+    insert_member(estimator);
+    patchbay.connect(&estimator.writeaccess, this, &if_t::update);
+    insert_member(prefilter);
+    patchbay.connect(&prefilter.writeaccess, this, &if_t::update);
+    insert_member(outlier_clip);
+    patchbay.connect(&outlier_clip.writeaccess, this, &if_t::update);
+    insert_member(auto_bandwidth);
+    patchbay.connect(&auto_bandwidth.writeaccess, this, &if_t::update);
+    insert_member(bandwidth_min);
+    patchbay.connect(&bandwidth_min.writeaccess, this, &if_t::update);
+    insert_member(bandwidth_max);
+    patchbay.connect(&bandwidth_max.writeaccess, this, &if_t::update);
+    insert_member(tuning_time);
+    patchbay.connect(&tuning_time.writeaccess, this, &if_t::update);
     insert_member(adjustment);
     patchbay.connect(&adjustment.writeaccess, this, &if_t::update);
+    insert_member(adjustment_source);
+    patchbay.connect(&adjustment_source.writeaccess, this, &if_t::update);
+    insert_member(timebase_name);
+    insert_member(offset_clock);
+    patchbay.connect(&offset_clock.writeaccess, this, &if_t::update);
+    insert_member(offset_bandwidth);
+    patchbay.connect(&offset_bandwidth.writeaccess, this, &if_t::update);
+    insert_member(step_threshold);
+    patchbay.connect(&step_threshold.writeaccess, this, &if_t::update);
 }
 
 void dll::if_t::prepare(mhaconfig_t& tf)
 {
     filtered_time_t0.data = filtered_time_t1.data =
-        std::numeric_limits<double>::quiet_NaN();
+        sample_index_n0.data = sample_index_n1.data =
+        current_bandwidth.data = std::numeric_limits<double>::quiet_NaN();
+    published_timebase.write(t::timing::timebase_snapshot_t());
+    // New signal dimensions or restart after dropout: acquire lock again
+    carried = t::timing::carry_t();
     if (isnanf(bandwidth.data))
         bandwidth.data = 19.2f / tf.fragsize;
+    timebase.reset();
+    try {
+        if (!timebase_name.data.empty())
+            timebase = std::make_unique<t::shm::timebase_t>
+                (timebase_name.data, true);
+    }
+    catch (const std::exception & e) {
+        throw MHA_Error(__FILE__, __LINE__, "%s", e.what());
+    }
     update();
 }
 
 void dll::if_t::release()
 {
+    timebase.reset();
 }
 
 void dll::if_t::update()
 {
+    if (bandwidth_min.data > bandwidth_max.data)
+        throw MHA_Error(__FILE__, __LINE__,
+                        "bandwidth_min (%g) exceeds bandwidth_max (%g)",
+                        bandwidth_min.data, bandwidth_max.data);
     if (is_prepared())
         push_config(new cfg_t(input_cfg(), bandwidth.data,
                               clock_source.data.get_value(),
-                              adjustment.data));
+                              adjustment.data,
+                              offset_clock.data.get_value(),
+                              offset_bandwidth.data,
+                              step_threshold.data,
+                              estimator.data.get_value(),
+                              prefilter.data.get_value(),
+                              outlier_clip.data,
+                              auto_bandwidth.data,
+                              bandwidth_min.data,
+                              bandwidth_max.data,
+                              tuning_time.data,
+                              adjustment_source.data));
 }
 
 template<class mha_xxxx_t> // "xxxx" is either "wave" or "spec"
 mha_xxxx_t* dll::if_t::process(mha_xxxx_t* s)
 {
-    std::pair<double,double> t0_t1 = poll_config()->process();
-    filtered_time_t0.data = t0_t1.first;
-    filtered_time_t1.data = t0_t1.second;
+    T_TRACE_SCOPE("dll.process");
+    cfg_t * cfg = poll_config();
+    if (cfg->n1 == 0U)
+        cfg->resume(carried);
+    std::pair<double,double> t0_t1 = cfg->process();
+    T_TRACE_VALUE("dll.raw_time", cfg->raw_time);
+    T_TRACE_VALUE("dll.loop_error", cfg->e);
+    carried = cfg->carry();
+    const double adjustment = ac_adjustment(ac, cfg->adjustment_source);
+    filtered_time_t0.data = t0_t1.first + adjustment;
+    filtered_time_t1.data = t0_t1.second + adjustment;
+    sample_index_n0.data = cfg->n0;
+    sample_index_n1.data = cfg->n1;
+    current_bandwidth.data = cfg->bandwidth();
+    t::timing::timebase_snapshot_t snapshot;
+    snapshot.t0 = filtered_time_t0.data;
+    snapshot.t1 = filtered_time_t1.data;
+    snapshot.period = cfg->period();
+    snapshot.adjustment = cfg->adjustment + adjustment;
+    snapshot.n0 = cfg->n0;
+    snapshot.n1 = cfg->n1;
+    snapshot.clock = cfg->map_to_offset_clock ? cfg->offset_clock
+                                              : cfg->clock_source;
+    snapshot.locked = cfg->locked();
+    published_timebase.write(snapshot);
+    if (timebase)
+        timebase->write(snapshot);
     return s;
 }
 
@@ -1,82 +1,34 @@
+#include <memory>
 #include <mha_plugin.hh>
+#include "ac_timebase.hh"
+#include "shm_timebase.hh"
+#include "timing.hh"
 
 namespace t::plugins::dll {
 
     /** Runtime configuration class of MHA plugin which implements the time
-        smoothing filter described in
-        Fons Adriensen: Using a DLL to filter time. 2005.
-        http://kokkinizita.linuxaudio.org/papers/usingdll.pdf */
-    class cfg_t {
+        smoothing filter, see t::timing::dll_t */
+    class cfg_t : public t::timing::dll_t {
     public:
         cfg_t(const mhaconfig_t & signal_dimensions,
               const double bandwidth,
               const std::string & clock_source_name,
-              const double adjustment = 0);
-        virtual ~cfg_t() = default;
-        /** Block update rate / Hz */
-        const double F;
-
-        /** Bandwidth of block update rate */
-        const double B;
-
-        /** 0th order parameter, always 0 */
-        static constexpr double a = 0.0f;
-
-        /** 1st order parameter, sqrt(2)2piB/F */
-        const double b;
-
-        /** 2nd order parameter, (2piB/F)^2 */
-        const double c;
-
-        /** number of samples per block */
-        const uint64_t nper;
-
-        /** nominal duration of 1 block in seconds */
-        const double tper;
-
-        /** Adjustment added to the filtered time stamps (in seconds) */
-        const double adjustment;
-
-        /** which clock clock_gettime should use */
-        clockid_t clock_source;
-
-        /** actual duration of 1 block of audio, in seconds.
-         * Initialized to nominal block duration at startup and after
-         * dropouts, then adapted to measured duration by the dll. */
-        double e2;
-
-        /** start time of the current block as predicted by the dll. */
-        double t0;
-
-        /** start time of the next block as predicted by the dll. */
-        double t1;
-
-        /** Total sample index of first sample in current block.
-         * Reset to zero for every dropout. */
-        uint64_t n0 = {0U};
-
-        /** Total sample index of first sample in next block.
-         * Reset to zero for every dropout. */
-        uint64_t n1 = {0U};
-
-        /** Difference between measured and predicted time. Adapts loop.*/
-        double e;
-
-        /** Queries the clock. Invokes filter_time.
-         * @return the filtered start times of this and the next buffer
-         *         in seconds  */
-        virtual std::pair<double,double> process();
-
-        /** Filters the input time */
-        virtual double filter_time(double unfiltered_time);
-
-        /** Filter the time for the first time: Initialize the loop state.
-         * @return unmodified input time */
-        virtual double dll_init(double unfiltered_time);
-
-        /** Filter the time regularly: Update the loop state.
-         * @return the prediction from last invocation. */
-        virtual double dll_update(double unfiltered_time);
+              const double adjustment = 0,
+              const std::string & offset_clock_name = "none",
+              const double offset_bandwidth = 0.1,
+              const double step_threshold = 2e-3,
+              const std::string & estimator_name = "dll",
+              const std::string & prefilter_name = "none",
+              const double outlier_clip = 0,
+              const bool auto_bandwidth = false,
+              const double bandwidth_min = 0.02,
+              const double bandwidth_max = 2.0,
+              const double tuning_time = 10.0,
+              const std::string & adjustment_source = "");
+
+        /** Name of an AC variable whose value is added to adjustment, e.g.
+         * the result of plugin latency.  Empty: none.  Applied by if_t. */
+        const std::string adjustment_source;
     };
 
     /** Interface class of MHA plugin which implements the time smoothing filter
@@ -100,12 +52,17 @@ namespace t::plugins::dll {
          * @param signal_dimensions Signal metadata:
          *                          srate and fragsize are used. */
         void prepare(mhaconfig_t & signal_dimensions);
-        /** Empty implementation of release. */
+        /** Closes the shared memory time base. */
         void release();
 
         /** Connects configuration events to actions. */
         MHAEvents::patchbay_t<if_t> patchbay;
 
+        /** State of the configuration used in the latest process callback.
+         * Owned by the processing thread, a new configuration resumes from
+         * it.  prepare() clears it. */
+        t::timing::carry_t carried;
+
         /** Start time of current buffer filtered with a delay locked loop
          * published as AC variable */
         MHA_AC::double_t filtered_time_t0;
@@ -114,6 +71,27 @@ namespace t::plugins::dll {
          * published as AC variable */
         MHA_AC::double_t filtered_time_t1;
 
+        /** Total sample index of first sample in current buffer,
+         * published as AC variable */
+        MHA_AC::double_t sample_index_n0;
+
+        /** Total sample index of first sample in next buffer,
+         * published as AC variable */
+        MHA_AC::double_t sample_index_n1;
+
+        /** Current bandwidth in Hz, published as AC variable */
+        MHA_AC::double_t current_bandwidth;
+
+        /** Times, sample indices and period of the current block as one
+         * consistent snapshot, published as AC variable for plugins in
+         * other threads */
+        t::plugins::timebase::publisher_t published_timebase;
+
+        /** Shared memory time base for other processes, nullptr if not
+         * published.  Opened by prepare() and held until release(), so
+         * that configuration changes keep the writer and its lock. */
+        std::unique_ptr<t::shm::timebase_t> timebase;
+
         MHAParser::float_t bandwidth =
             {"Bandwidth of the delay-locked-loop in Hz." ,"NaN", "]0,]"};
 
@@ -124,10 +102,72 @@ namespace t::plugins::dll {
              " CLOCK_BOOTTIME CLOCK_PROCESS_CPUTIME_ID CLOCK_THREAD_CPUTIME_ID]"
             };
 
+        MHAParser::kw_t estimator =
+            {"Estimator filtering the times:\n"
+             "dll: second order delay-locked loop,\n"
+             "kalman: two-state Kalman filter, faster acquisition,\n"
+             "rls: least-squares line fit over the last F/(2B) blocks",
+             "dll", "[dll kalman rls]"};
+
+        MHAParser::kw_t prefilter =
+            {"Robust pre-filter of the measured times:\n"
+             "none: use every measurement as is,\n"
+             "pair: average each measurement with the previous one, cancels\n"
+             "alternating quantization of the callback times,\n"
+             "median3, median5: median of the last 3 or 5 measurements,\n"
+             "rejects isolated outliers",
+             "none", "[none pair median3 median5]"};
+
+        MHAParser::float_t outlier_clip =
+            {"Clip the loop error to this many standard deviations of the\n"
+             "observed loop error.  0: no clipping", "0", "[0,]"};
+
+        MHAParser::bool_t auto_bandwidth =
+            {"Tune the bandwidth continuously to the jitter and the drift\n"
+             "of the measured times, starting at bandwidth", "no"};
+
+        MHAParser::float_t bandwidth_min =
+            {"Lower bound of the tuned bandwidth in Hz", "0.02", "]0,]"};
+
+        MHAParser::float_t bandwidth_max =
+            {"Upper bound of the tuned bandwidth in Hz", "2", "]0,]"};
+
+        MHAParser::float_t tuning_time =
+            {"Time constant of the noise estimates of the tuner in seconds",
+             "10", "]0,]"};
+
         MHAParser::float_t adjustment =
             {"Additive adjustment for the filtered times, can e.g. be used to\n"
              "account for either input or output latency", "0", "[,]"};
 
+        MHAParser::string_t adjustment_source =
+            {"Name of an AC variable whose value is added to adjustment in\n"
+             "every block, e.g. latency_adjustment measured by plugin\n"
+             "latency.  Empty, missing or NaN: nothing is added", ""};
+
+        MHAParser::string_t timebase_name =
+            {"Name of a POSIX shared memory segment, starting with '/', in\n"
+             "which the filtered times are published for other processes on\n"
+             "this host, see shm_timebase.hh.  Only one dll can write a\n"
+             "segment.  Empty: not published.  Takes effect at the next\n"
+             "prepare", ""};
+
+        MHAParser::kw_t offset_clock =
+            {"Clock onto which the filtered times are mapped with a slowly\n"
+             "filtered offset, e.g. CLOCK_REALTIME when clock_source is\n"
+             "CLOCK_MONOTONIC_RAW.  none: publish times of clock_source",
+             "none","[none CLOCK_REALTIME CLOCK_REALTIME_COARSE"
+             " CLOCK_MONOTONIC CLOCK_MONOTONIC_COARSE CLOCK_MONOTONIC_RAW"
+             " CLOCK_BOOTTIME]"
+            };
+
+        MHAParser::float_t offset_bandwidth =
+            {"Bandwidth of the offset filter in Hz", "0.1", "]0,]"};
+
+        MHAParser::float_t step_threshold =
+            {"Offset changes larger than this are treated as clock steps\n"
+             "and are taken over immediately, in seconds", "2e-3", "]0,]"};
+
         virtual void update(void);
     };
 }
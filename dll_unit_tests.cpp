@@ -1,6 +1,19 @@
 #include "dll.hh"
+#include "clocksim.hh"
+#include "latency.hh"
+#include "playout.hh"
+#include "band_energy.hh"
+#include "shm_ring.hh"
+#include "syncmeter.hh"
+#include "drift.hh"
 #include <gmock/gmock.h>
 #include <mha_algo_comm.hh>
+#include <mha_signal.hh>
+#include <complex>
+#include <random>
+#include <cstddef>
+#include <thread>
+#include <vector>
 
 class public_if_t : public t::plugins::dll::if_t {
 public:
@@ -17,7 +30,7 @@ public:
 class if_t_fixture : public ::testing::Test {
 public:
     MHAKernel::algo_comm_class_t algo_comm;
-    mock_if_t dll = {algo_comm.get_c_handle(), "", "dllplugin"};
+    mock_if_t dll = {algo_comm.get_c_handle(), "dllplugin"};
     mhaconfig_t signal_dimensions =
         {.channels=1, .domain=MHA_WAVEFORM, .fragsize=96, .wndlen=400,
          .fftlen=800, .srate=44100};
@@ -31,7 +44,7 @@ TEST_F(if_t_fixture, has_patchbay_connect_bandwidth_to_update) {
 }
 
 TEST_F(if_t_fixture, prepare_pushes_config_replaces_NaN) {
-    public_if_t dll = {algo_comm.get_c_handle(), "", "dllplugin"};
+    public_if_t dll = {algo_comm.get_c_handle(), "dllplugin"};
     EXPECT_EQ("nan", dll.parse("bandwidth?val"));
     EXPECT_THROW(dll.poll_config(), MHA_Error);
     dll.prepare_(signal_dimensions);
@@ -59,8 +72,8 @@ TEST_F(if_t_fixture, all_clock_sources) {
 }
 
 TEST_F(if_t_fixture, prepare_propagates_correct_parameters) {
-    public_if_t dll02 = {algo_comm.get_c_handle(), "", "dllplugin02"};
-    public_if_t dll10 = {algo_comm.get_c_handle(), "", "dllplugin10"};
+    public_if_t dll02 = {algo_comm.get_c_handle(), "dllplugin02"};
+    public_if_t dll10 = {algo_comm.get_c_handle(), "dllplugin10"};
     dll02.parse("bandwidth=0.2");
     dll10.parse("bandwidth=1.0");
     dll02.prepare_(signal_dimensions);
@@ -100,7 +113,7 @@ TEST_F(if_t_fixture, prepare_propagates_correct_parameters) {
 }
 
 TEST_F(if_t_fixture, propagate_clock_sources) {
-    public_if_t dll = {algo_comm.get_c_handle(), "", "dllplugin"};
+    public_if_t dll = {algo_comm.get_c_handle(), "dllplugin"};
     const std::map<std::string, clockid_t> clock_sources =
         {{"CLOCK_REALTIME", CLOCK_REALTIME},
          {"CLOCK_BOOTTIME", CLOCK_BOOTTIME},
@@ -150,6 +163,998 @@ TEST(cfg_t, filter_sample_times) {
     }
 }
 
+TEST(cfg_t, all_estimators_converge_to_linear_times) {
+    const mhaconfig_t signal_dimensions =
+        {.channels=1, .domain=MHA_WAVEFORM, .fragsize=96, .wndlen=400,
+         .fftlen=800, .srate=48000};
+    // sound card clock 60ppm faster than nominal, no jitter
+    const double actual_tper = 96 / 48003.0;
+    for (const std::string name : {"dll", "kalman", "rls"}) {
+        t::plugins::dll::cfg_t cfg = {signal_dimensions, 0.2,
+                                      "CLOCK_REALTIME", 0, "none", 0.1, 2e-3,
+                                      name};
+        double actual = 0.0;
+        for (unsigned block = 0; block < 20000U; ++block)
+            actual = cfg.filter_time(1000.0 + block * actual_tper);
+        EXPECT_NEAR(1000.0 + 19999 * actual_tper, actual, 1e-8) << name;
+        EXPECT_NEAR(actual_tper, cfg.e2, 1e-10) << name;
+        EXPECT_EQ(20000U * 96U, cfg.n1) << name;
+    }
+}
+
+TEST(cfg_t, estimators_filter_sample_times) {
+    const mhaconfig_t signal_dimensions =
+        {.channels=1, .domain=MHA_WAVEFORM, .fragsize=96, .wndlen=400,
+         .fftlen=800, .srate=44100};
+    // first and last raw time stamps of the filter_sample_times test, the
+    // raw times alternate between approximately +-50us around the line
+    const double first = 1592895666.1088159, last = 1592895666.324276;
+    const double tper = (last - first) / 99;
+    std::vector<double> sample_times;
+    for (unsigned k = 0; k < 100U; ++k)
+        sample_times.push_back(first + k * tper + ((k & 1) ? 50e-6 : -50e-6));
+    for (const std::string name : {"kalman", "rls"}) {
+        t::plugins::dll::cfg_t cfg = {signal_dimensions, 0.2,
+                                      "CLOCK_REALTIME", 0, "none", 0.1, 2e-3,
+                                      name};
+        for (unsigned k = 0; k < sample_times.size(); ++k) {
+            double actual = cfg.filter_time(sample_times[k]);
+            if (k >= 20U)
+                EXPECT_NEAR(first + k * tper, actual, 20e-6)
+                    << name << " index k=" << k;
+        }
+    }
+}
+
+namespace {
+    /** Filters times on a line with alternating quantization of +-79us
+     * and an optional outlier of 2ms in block 4000.
+     * @return maximum deviation of the filtered times from the line in the
+     *         last 2000 of 5000 blocks */
+    double max_deviation(const std::string & prefilter, double clip,
+                         bool outlier) {
+        const mhaconfig_t signal_dimensions =
+            {.channels=1, .domain=MHA_WAVEFORM, .fragsize=96, .wndlen=400,
+             .fftlen=800, .srate=48000};
+        t::plugins::dll::cfg_t cfg = {signal_dimensions, 2.0,
+                                      "CLOCK_REALTIME", 0, "none", 0.1, 2e-3,
+                                      "dll", prefilter, clip};
+        double deviation = 0.0;
+        for (unsigned block = 0; block < 5000U; ++block) {
+            const double line = 1000.0 + block * cfg.tper;
+            double time = line + ((block & 1U) ? 79e-6 : -79e-6);
+            if (outlier && block == 4000U)
+                time += 2e-3;
+            const double actual = cfg.filter_time(time);
+            if (block >= 3000U)
+                deviation = std::max(deviation, std::fabs(actual - line));
+        }
+        return deviation;
+    }
+}
+
+TEST(cfg_t, prefilter_pair_cancels_alternating_quantization) {
+    EXPECT_GT(max_deviation("none", 0, false), 1e-6);
+    EXPECT_LT(max_deviation("pair", 0, false), 1e-7);
+}
+
+TEST(cfg_t, prefilter_rejects_outliers) {
+    EXPECT_GT(max_deviation("none", 0, true), 50e-6);
+    EXPECT_LT(max_deviation("none", 4, true), 25e-6);
+    EXPECT_LT(max_deviation("median3", 0, true), 25e-6);
+}
+
+TEST(cfg_t, resume_continues_locked_loop) {
+    const mhaconfig_t signal_dimensions =
+        {.channels=1, .domain=MHA_WAVEFORM, .fragsize=96, .wndlen=400,
+         .fftlen=800, .srate=48000};
+    const double actual_tper = 96 / 48003.0;
+    for (const std::string name : {"dll", "kalman", "rls"}) {
+        t::plugins::dll::cfg_t previous = {signal_dimensions, 0.2,
+                                           "CLOCK_REALTIME", 0, "none", 0.1,
+                                           2e-3, name};
+        unsigned block = 0;
+        for (; block < 20000U; ++block)
+            previous.filter_time(1000.0 + block * actual_tper);
+        // new bandwidth, same signal dimensions
+        t::plugins::dll::cfg_t cfg = {signal_dimensions, 1.0,
+                                      "CLOCK_REALTIME", 0, "none", 0.1,
+                                      2e-3, name};
+        cfg.resume(previous.carry());
+        for (unsigned k = 0; k < 100U; ++k, ++block) {
+            double actual = cfg.filter_time(1000.0 + block * actual_tper);
+            EXPECT_NEAR(1000.0 + block * actual_tper, actual, 1e-9)
+                << name << " block " << block;
+        }
+        EXPECT_EQ(uint64_t(block) * 96U, cfg.n1) << name;
+    }
+}
+
+TEST(cfg_t, resume_translates_clock_source) {
+    const mhaconfig_t signal_dimensions =
+        {.channels=1, .domain=MHA_WAVEFORM, .fragsize=96, .wndlen=400,
+         .fftlen=800, .srate=48000};
+    t::plugins::dll::cfg_t previous = {signal_dimensions, 0.2,
+                                       "CLOCK_REALTIME"};
+    previous.process();
+    t::plugins::dll::cfg_t cfg = {signal_dimensions, 0.2,
+                                  "CLOCK_MONOTONIC"};
+    cfg.resume(previous.carry());
+    EXPECT_EQ(previous.n1, cfg.n1);
+    struct timespec ts = {.tv_sec=0, .tv_nsec=0};
+    ASSERT_EQ(0, clock_gettime(CLOCK_MONOTONIC, &ts));
+    double monotonic = ts.tv_sec + ts.tv_nsec / 1e9;
+    EXPECT_NEAR(monotonic, cfg.process().first, 5e-3);
+    EXPECT_EQ(previous.n1, cfg.n0);
+}
+
+TEST_F(if_t_fixture, reconfiguration_keeps_lock) {
+    public_if_t dll = {algo_comm.get_c_handle(), "dllplugin"};
+    MHASignal::waveform_t signal = {96U, 1U};
+    dll.prepare_(signal_dimensions);
+    for (unsigned block = 0; block < 10U; ++block)
+        dll.process(&signal);
+    dll.parse("adjustment=1e-6");
+    dll.process(&signal);
+    EXPECT_EQ(10U * 96U, dll.sample_index_n0.data);
+    // prepare starts a new loop
+    dll.release_();
+    dll.prepare_(signal_dimensions);
+    dll.process(&signal);
+    EXPECT_EQ(0U, dll.sample_index_n0.data);
+}
+
+TEST_F(if_t_fixture, adjustment_source_is_added) {
+    public_if_t dll = {algo_comm.get_c_handle(), "dllplugin"};
+    MHA_AC::double_t source = {algo_comm.get_c_handle(), "calibration",
+                               std::numeric_limits<double>::quiet_NaN()};
+    MHASignal::waveform_t signal = {96U, 1U};
+    dll.parse("adjustment_source=calibration");
+    dll.prepare_(signal_dimensions);
+    for (unsigned block = 0; block < 10U; ++block)
+        dll.process(&signal);
+    // NaN is ignored, a value is applied from the next block on
+    const double t1 = dll.filtered_time_t1.data;
+    source.data = 2e-3;
+    dll.process(&signal);
+    EXPECT_NEAR(t1 + 2e-3, dll.filtered_time_t0.data, 1e-6);
+}
+
+TEST_F(if_t_fixture, timebase_is_published_for_other_processes) {
+    public_if_t dll = {algo_comm.get_c_handle(), "dllplugin"};
+    MHASignal::waveform_t signal = {96U, 1U};
+    // A segment left by an aborted run would continue its sequence
+    shm_unlink("/dll_unit_tests_timebase");
+    dll.parse("timebase_name=/dll_unit_tests_timebase");
+    dll.prepare_(signal_dimensions);
+    const t::shm::timebase_t reader = {"/dll_unit_tests_timebase", false};
+    t::timing::timebase_snapshot_t snapshot;
+    ASSERT_TRUE(reader.read(snapshot));
+    EXPECT_EQ(0U, snapshot.n1);
+    for (unsigned block = 0; block < 10U; ++block)
+        dll.process(&signal);
+    ASSERT_TRUE(reader.read(snapshot));
+    EXPECT_EQ(20U, snapshot.sequence);
+    EXPECT_EQ(dll.filtered_time_t0.data, snapshot.t0);
+    EXPECT_EQ(dll.filtered_time_t1.data, snapshot.t1);
+    EXPECT_EQ(dll.sample_index_n0.data, snapshot.n0);
+    EXPECT_EQ(CLOCK_REALTIME, snapshot.clock);
+    EXPECT_EQ(0U, snapshot.locked); // 1/B = 5 s have not passed
+    EXPECT_NEAR(snapshot.t1, snapshot.time_of(snapshot.n1), 1e-6);
+    EXPECT_NEAR(44100.0, snapshot.rate(), 100.0);
+    EXPECT_NEAR(snapshot.sample_at(snapshot.now()), snapshot.n1, 96.0 * 4);
+    // A second dll cannot write the same segment
+    public_if_t second = {algo_comm.get_c_handle(), "second"};
+    second.parse("timebase_name=/dll_unit_tests_timebase");
+    EXPECT_THROW(second.prepare_(signal_dimensions), MHA_Error);
+    shm_unlink("/dll_unit_tests_timebase");
+}
+
+TEST_F(if_t_fixture, timebase_ac_variable_serves_parallel_branches) {
+    public_if_t dll = {algo_comm.get_c_handle(), "dllplugin"};
+    MHASignal::waveform_t signal = {96U, 1U};
+    dll.prepare_(signal_dimensions);
+    t::plugins::timebase::reader_t reader =
+        {algo_comm.get_c_handle(), "dllplugin", 96U};
+    double t0 = 0.0, dt = 0.0;
+    reader.next_block(t0, dt);
+    EXPECT_TRUE(std::isnan(t0)); // nothing published yet
+    for (unsigned block = 0; block < 10U; ++block)
+        dll.process(&signal);
+    // The branch runs after the dll in this block
+    reader.next_block(t0, dt);
+    EXPECT_EQ(dll.filtered_time_t0.data, t0);
+    EXPECT_NEAR((dll.filtered_time_t1.data - t0) / 96, dt, 1e-12);
+    // and before the dll in the next one
+    const double t1 = dll.filtered_time_t1.data;
+    reader.next_block(t0, dt);
+    EXPECT_NEAR(t1, t0, 1e-6);
+    dll.process(&signal);
+    EXPECT_NEAR(dll.filtered_time_t0.data, t0, 1e-6);
+    dll.process(&signal);
+    reader.next_block(t0, dt);
+    EXPECT_EQ(dll.filtered_time_t0.data, t0);
+
+    // Time sources without the seqlock are read from _t0 and _t1
+    MHA_AC::double_t other_t0 = {algo_comm.get_c_handle(), "other_t0", 1.0};
+    MHA_AC::double_t other_t1 = {algo_comm.get_c_handle(), "other_t1", 1.002};
+    t::plugins::timebase::reader_t other =
+        {algo_comm.get_c_handle(), "other", 96U};
+    other.next_block(t0, dt);
+    EXPECT_EQ(1.0, t0);
+    EXPECT_NEAR(0.002 / 96, dt, 1e-15);
+}
+
+TEST_F(if_t_fixture, timebase_reader_running_before_the_dll_is_not_late) {
+    t::plugins::timebase::publisher_t publisher =
+        {algo_comm.get_c_handle(), "source_timebase"};
+    t::plugins::timebase::reader_t reader =
+        {algo_comm.get_c_handle(), "source", 96U};
+    t::timing::timebase_snapshot_t s;
+    s.period = 96.0 / 44100;
+    s.adjustment = 0.5; // must not confuse the first block
+    // The dll processed its latest block one period before the reader's
+    const double processed = s.now() - s.period;
+    for (unsigned block = 0; block < 20U; ++block) {
+        s.n0 = block * 96U;
+        s.n1 = s.n0 + 96U;
+        s.t0 = processed + block * s.period + s.adjustment;
+        s.t1 = s.t0 + s.period;
+        publisher.write(s);
+        double t0 = 0.0, dt = 0.0;
+        reader.next_block(t0, dt); // always before the dll in this block
+        EXPECT_EQ(s.time_of(s.n1), t0) << block;
+    }
+}
+
+TEST_F(if_t_fixture, timebase_reader_resynchronizes_after_dll_restart) {
+    auto publisher = std::make_unique<t::plugins::timebase::publisher_t>
+        (algo_comm.get_c_handle(), "source_timebase");
+    t::plugins::timebase::reader_t reader =
+        {algo_comm.get_c_handle(), "source", 48U};
+    t::timing::timebase_snapshot_t s;
+    s.period = 96.0 / 44100;
+    s.t0 = s.now() + 1.0; // processed in the future: reader is in block n0
+    s.t1 = s.t0 + s.period;
+    s.n0 = 960000U;
+    s.n1 = s.n0 + 96U;
+    publisher->write(s);
+    double t0 = 0.0, dt = 0.0;
+    reader.next_block(t0, dt);
+    EXPECT_EQ(s.time_of(960000U), t0);
+    EXPECT_NEAR(s.period / 96, dt, 1e-15);
+    // The reader advances by its own block size, not by the dll's
+    reader.next_block(t0, dt);
+    EXPECT_EQ(s.time_of(960048U), t0);
+
+    // The dll restarts and counts from 0 again
+    s.n0 = 0U;
+    s.n1 = 96U;
+    publisher->write(s);
+    reader.next_block(t0, dt);
+    EXPECT_EQ(s.time_of(0U), t0);
+    reader.next_block(t0, dt);
+    EXPECT_EQ(s.time_of(48U), t0);
+
+    // A new dll restarts the sequence, even if its samples are close
+    publisher.reset();
+    publisher = std::make_unique<t::plugins::timebase::publisher_t>
+        (algo_comm.get_c_handle(), "source_timebase");
+    s.n0 = 0U;
+    s.n1 = 96U;
+    publisher->write(s);
+    reader.next_block(t0, dt);
+    EXPECT_EQ(s.time_of(0U), t0);
+}
+
+TEST_F(if_t_fixture, propagate_estimator) {
+    public_if_t dll = {algo_comm.get_c_handle(), "dllplugin"};
+    dll.prepare_(signal_dimensions);
+    EXPECT_TRUE(std::holds_alternative<t::timing::dll_estimator_t>
+                (dll.poll_config()->estimator));
+    dll.parse("estimator=kalman");
+    EXPECT_TRUE(std::holds_alternative<t::timing::kalman_estimator_t>
+                (dll.poll_config()->estimator));
+    dll.parse("estimator=rls");
+    EXPECT_TRUE(std::holds_alternative<t::timing::rls_estimator_t>
+                (dll.poll_config()->estimator));
+    EXPECT_THROW(dll.parse("estimator=invalid_name"), MHA_Error);
+}
+
+TEST_F(if_t_fixture, propagate_prefilter) {
+    public_if_t dll = {algo_comm.get_c_handle(), "dllplugin"};
+    dll.prepare_(signal_dimensions);
+    EXPECT_EQ(1U, dll.poll_config()->prefilter.history);
+    EXPECT_EQ(0.0, dll.poll_config()->prefilter.clip);
+    dll.parse("prefilter=median5");
+    dll.parse("outlier_clip=4");
+    EXPECT_EQ(5U, dll.poll_config()->prefilter.history);
+    EXPECT_EQ(4.0, dll.poll_config()->prefilter.clip);
+    EXPECT_THROW(dll.parse("prefilter=invalid_name"), MHA_Error);
+}
+
+TEST_F(if_t_fixture, propagate_auto_bandwidth) {
+    public_if_t dll = {algo_comm.get_c_handle(), "dllplugin"};
+    MHASignal::waveform_t signal = {96U, 1U};
+    dll.prepare_(signal_dimensions);
+    EXPECT_FALSE(dll.poll_config()->auto_bandwidth);
+    dll.parse("auto_bandwidth=yes");
+    dll.parse("bandwidth_min=0.05");
+    dll.parse("bandwidth_max=1");
+    t::plugins::dll::cfg_t * cfg = dll.poll_config();
+    EXPECT_TRUE(cfg->auto_bandwidth);
+    EXPECT_DOUBLE_EQ(2 * M_PI * 0.05 / cfg->F, cfg->tuner.omega_min);
+    EXPECT_DOUBLE_EQ(2 * M_PI * 1.0 / cfg->F, cfg->tuner.omega_max);
+    dll.process(&signal);
+    EXPECT_FLOAT_EQ(19.2f / 96, dll.current_bandwidth.data);
+    EXPECT_THROW(dll.parse("bandwidth_min=2"), MHA_Error);
+}
+
+TEST(cfg_t, retune_keeps_locked_loop) {
+    const mhaconfig_t signal_dimensions =
+        {.channels=1, .domain=MHA_WAVEFORM, .fragsize=96, .wndlen=400,
+         .fftlen=800, .srate=48000};
+    const double actual_tper = 96 / 48003.0;
+    for (const std::string name : {"dll", "kalman", "rls"}) {
+        t::plugins::dll::cfg_t cfg = {signal_dimensions, 0.2,
+                                      "CLOCK_REALTIME", 0, "none", 0.1,
+                                      2e-3, name};
+        unsigned block = 0;
+        for (; block < 20000U; ++block)
+            cfg.filter_time(1000.0 + block * actual_tper);
+        std::visit([&](auto & policy) {
+            policy.retune(cfg, 4 * cfg.omega, cfg.tper);
+        }, cfg.estimator);
+        for (unsigned k = 0; k < 100U; ++k, ++block) {
+            double actual = cfg.filter_time(1000.0 + block * actual_tper);
+            EXPECT_NEAR(1000.0 + block * actual_tper, actual, 1e-9)
+                << name << " block " << block;
+        }
+    }
+}
+
+TEST(estimators, rls_fits_a_line_through_its_window) {
+    // The estimator state does not grow with the window
+    EXPECT_LT(sizeof(t::timing::rls_estimator_t), 4096U);
+    const double tper = 96 / 48000.0;
+    std::mt19937 generator(1);
+    std::normal_distribution<double> jitter(0.0, 20e-6);
+    std::vector<double> times;
+    for (double window : {100.0, 1250.0}) {
+        t::timing::rls_estimator_t rls(window);
+        t::timing::loop_state_t s;
+        times.assign(1U, 0.0);
+        rls.init(s, 0.0, tper);
+        for (unsigned k = 1; k < 4000U; ++k) {
+            times.push_back(k * tper * 1.00003 + jitter(generator));
+            rls.update(s, times.back());
+        }
+        EXPECT_GE(rls.n, rls.W - rls.D + 1U);
+        EXPECT_LE(rls.n, rls.W);
+        // Least squares fit through the last n times
+        double Sx = 0, Sy = 0, Sxx = 0, Sxy = 0;
+        for (unsigned k = times.size() - rls.n; k < times.size(); ++k) {
+            Sx += k;
+            Sy += times[k];
+            Sxx += double(k) * k;
+            Sxy += k * times[k];
+        }
+        const double slope = (rls.n * Sxy - Sx * Sy) / (rls.n * Sxx - Sx * Sx);
+        const double intercept = (Sy - slope * Sx) / rls.n;
+        EXPECT_NEAR(intercept + slope * times.size(), s.t1, 1e-9) << window;
+        EXPECT_NEAR(slope, s.e2, 1e-11) << window;
+    }
+}
+
+TEST(cfg_t, filter_offset_tracks_slew_and_absorbs_steps) {
+    const mhaconfig_t signal_dimensions =
+        {.channels=1, .domain=MHA_WAVEFORM, .fragsize=96, .wndlen=400,
+         .fftlen=800, .srate=44100};
+    t::plugins::dll::cfg_t cfg = {signal_dimensions, 0.2, "CLOCK_MONOTONIC_RAW",
+                                  0, "CLOCK_REALTIME", 0.1, 2e-3};
+    EXPECT_TRUE(cfg.map_to_offset_clock);
+    EXPECT_EQ(CLOCK_REALTIME, cfg.offset_clock);
+    // offset slewed by 100ppm, like an NTP daemon would do
+    const double slew = 100e-6 * cfg.tper;
+    double offset = 100.0;
+    for (unsigned block = 0; block < 20000U; ++block, offset += slew)
+        cfg.filter_offset(offset);
+    EXPECT_EQ(0U, cfg.steps);
+    EXPECT_NEAR(offset - slew, cfg.offset, 1e-9);
+    EXPECT_NEAR(slew, cfg.offset_drift, 1e-12);
+    // clock step of 0.5s is taken over immediately
+    EXPECT_EQ(offset + 0.5, cfg.filter_offset(offset + 0.5));
+    EXPECT_EQ(1U, cfg.steps);
+    // invalid measurements do not change the offset
+    EXPECT_EQ(offset + 0.5,
+              cfg.filter_offset(std::numeric_limits<double>::quiet_NaN()));
+}
+
+TEST(timing, bracketed_offset_ignores_preempted_reads) {
+    // Source clock reads, offset clock is always 100s ahead of the
+    // midpoint of its bracket.  The first attempt is preempted for 3ms
+    // after the read of the offset clock.
+    std::vector<double> source_reads = {1.0, 1.003, 2.0, 2.000002};
+    size_t next_read = 0;
+    auto source = [&] {return source_reads.at(next_read++);};
+    auto other = [&] {return source_reads.at(next_read - 1U) + 100.000001;};
+    const double offset = t::timing::bracketed_offset(source, other);
+    EXPECT_NEAR(100.0, offset, 1e-9);
+    EXPECT_EQ(4U, next_read);
+    // Preempted during every attempt: no measurement
+    source_reads = {1.0, 1.003, 2.0, 2.003, 3.0, 3.003};
+    next_read = 0;
+    EXPECT_TRUE(std::isnan(t::timing::bracketed_offset(source, other)));
+    EXPECT_EQ(6U, next_read);
+}
+
+TEST(cfg_t, process_maps_onto_offset_clock) {
+    const mhaconfig_t signal_dimensions =
+        {.channels=1, .domain=MHA_WAVEFORM, .fragsize=96, .wndlen=400,
+         .fftlen=800, .srate=44100};
+    t::plugins::dll::cfg_t cfg = {signal_dimensions, 0.2, "CLOCK_MONOTONIC_RAW",
+                                  0, "CLOCK_REALTIME"};
+    struct timespec ts_expected = {.tv_sec=0, .tv_nsec=0};
+    ASSERT_EQ(0, clock_gettime(CLOCK_REALTIME, &ts_expected));
+    double d_expected = ts_expected.tv_sec + ts_expected.tv_nsec / 1e9;
+    double d_actual = cfg.process().first;
+    EXPECT_NEAR(d_expected, d_actual, 5e-5); // tolerance may need extension
+    // without offset clock, the dll publishes times of clock_source
+    t::plugins::dll::cfg_t raw = {signal_dimensions, 0.2, "CLOCK_MONOTONIC_RAW"};
+    EXPECT_FALSE(raw.map_to_offset_clock);
+    EXPECT_GT(std::fabs(raw.process().first - d_expected), 1.0);
+}
+
+namespace sim = t::timing::sim;
+
+TEST(sim, simulation_is_deterministic) {
+    sim::model_t model;
+    model.jitter = 50e-6;
+    model.quantum = 158.31e-6;
+    const sim::run_t first = sim::run(model, sim::loop_t());
+    const sim::run_t second = sim::run(model, sim::loop_t());
+    EXPECT_EQ(first.deviation, second.deviation);
+    model.seed = 2U;
+    EXPECT_NE(first.deviation, sim::run(model, sim::loop_t()).deviation);
+}
+
+TEST(sim, dll_settles_and_filters_jitter) {
+    // Regression values of the dll at 96 samples, 48 kHz, 50us jitter
+    sim::model_t model;
+    model.jitter = 50e-6;
+    sim::loop_t loop;
+    loop.bandwidth = 0.2;
+    sim::result_t narrow = sim::simulate(model, loop);
+    EXPECT_NEAR(3.02, narrow.settle, 0.05);
+    EXPECT_NEAR(2.48e-6, narrow.rms, 0.05e-6);
+    EXPECT_LT(narrow.max, 11e-6);
+    loop.bandwidth = 1.0;
+    sim::result_t wide = sim::simulate(model, loop);
+    EXPECT_NEAR(0.42, wide.settle, 0.05);
+    EXPECT_NEAR(5.61e-6, wide.rms, 0.05e-6);
+}
+
+TEST(sim, dll_recovers_from_xruns_and_clock_steps) {
+    sim::model_t model;
+    model.jitter = 20e-6;
+    model.xrun_interval = 10.0;
+    sim::loop_t loop;
+    loop.bandwidth = 1.0;
+    sim::result_t xruns = sim::simulate(model, loop);
+    EXPECT_EQ(5U, xruns.disturbances);
+    EXPECT_NEAR(1.95, xruns.recovery, 0.05);
+    model.xrun_interval = 0.0;
+    model.step_interval = 20.0;
+    model.step = 1e-3;
+    sim::result_t steps = sim::simulate(model, loop);
+    EXPECT_EQ(2U, steps.disturbances);
+    EXPECT_NEAR(1.47, steps.recovery, 0.05);
+    // the dual clock mode absorbs only steps above step_threshold at once
+    model.step = 3e-3;
+    loop.dual_clock = true;
+    EXPECT_LT(sim::simulate(model, loop).recovery, 0.1);
+}
+
+TEST(sim, auto_bandwidth_follows_the_noise) {
+    sim::model_t model;
+    model.duration = 300.0;
+    sim::loop_t fixed, tuned;
+    tuned.auto_bandwidth = true;
+    // Jitter only: the narrowest bandwidth is best
+    model.jitter = 50e-6;
+    sim::result_t result = sim::simulate(model, tuned);
+    EXPECT_NEAR(tuned.bandwidth_min, result.bandwidth, 0.01);
+    EXPECT_LT(result.rms, 0.5 * sim::simulate(model, fixed).rms);
+    // Wandering crystal: best fixed bandwidth is about 0.5 Hz
+    model.jitter = 2e-6;
+    model.wander_ppm = 1.0;
+    result = sim::simulate(model, tuned);
+    EXPECT_GT(result.bandwidth, 0.3);
+    EXPECT_LT(result.bandwidth, 1.0);
+    EXPECT_LT(result.rms, 0.7 * sim::simulate(model, fixed).rms);
+}
+
+namespace {
+    /** Writes frames first..first+frames-1 of 3 channels, sample value
+     * 10*frame+channel, time stamp frame/48000 */
+    void write_frames(t::shm::ring_t & ring, unsigned first, unsigned frames) {
+        std::vector<float> samples(3U * frames);
+        std::vector<double> timestamps(frames);
+        for (unsigned k = 0; k < frames; ++k) {
+            for (unsigned ch = 0; ch < 3U; ++ch)
+                samples[3U * k + ch] = 10.0f * (first + k) + ch;
+            timestamps[k] = (first + k) / 48000.0;
+        }
+        ring.write(samples.data(), timestamps.data(), frames);
+    }
+
+    /** Reads up to 8 frames.
+     * @return index of the first frame read, -1 if none was read */
+    int read_frames(t::shm::ring_t & ring, uint64_t & read_index,
+                    unsigned & frames) {
+        float samples[3 * 8];
+        double timestamps[8];
+        frames = ring.read(samples, timestamps, 8U, read_index);
+        if (frames == 0U)
+            return -1;
+        const int first = int(std::lround(timestamps[0] * 48000.0));
+        for (unsigned k = 0; k < frames; ++k) {
+            EXPECT_EQ((first + k) / 48000.0, timestamps[k]);
+            for (unsigned ch = 0; ch < 3U; ++ch)
+                EXPECT_EQ(10.0f * (first + k) + ch, samples[3U * k + ch]);
+        }
+        return first;
+    }
+}
+
+TEST(shm_ring, wraps_around) {
+    shm_unlink("/dll_unit_tests_ring");
+    // 3 channels * 7 frames is an odd number of floats
+    EXPECT_EQ(0U, t::shm::ring_t::timestamps_offset(3U, 7U) % alignof(double));
+    t::shm::ring_t writer = {"/dll_unit_tests_ring", 3U, 7U, 48000.0, true};
+    t::shm::ring_t reader = {"/dll_unit_tests_ring", 3U, 0U, 0.0, false};
+    uint64_t read_index = reader.write_index();
+    unsigned frames = 0U;
+    for (unsigned block = 0; block < 20U; ++block) {
+        write_frames(writer, 3U * block, 3U);
+        EXPECT_EQ(int(3U * block), read_frames(reader, read_index, frames));
+        EXPECT_EQ(3U, frames);
+    }
+    EXPECT_EQ(60U, read_index);
+    EXPECT_EQ(-1, read_frames(reader, read_index, frames));
+    shm_unlink("/dll_unit_tests_ring");
+}
+
+TEST(shm_ring, overrun_skips_to_recent_frames) {
+    shm_unlink("/dll_unit_tests_ring");
+    t::shm::ring_t writer = {"/dll_unit_tests_ring", 3U, 8U, 48000.0, true};
+    t::shm::ring_t reader = {"/dll_unit_tests_ring", 3U, 0U, 0.0, false};
+    uint64_t read_index = reader.write_index();
+    for (unsigned block = 0; block < 10U; ++block)
+        write_frames(writer, 3U * block, 3U);
+    unsigned frames = 0U;
+    // Only the latest capacity/2 frames are safe from the writer
+    EXPECT_EQ(26, read_frames(reader, read_index, frames));
+    EXPECT_EQ(4U, frames);
+    EXPECT_EQ(30U, read_index);
+    shm_unlink("/dll_unit_tests_ring");
+}
+
+TEST(shm_ring, readers_notice_writer_restart) {
+    shm_unlink("/dll_unit_tests_ring");
+    unsigned frames = 0U;
+    auto writer = std::make_unique<t::shm::ring_t>
+        ("/dll_unit_tests_ring", 3U, 8U, 48000.0, true);
+    auto reader = std::make_unique<t::shm::ring_t>
+        ("/dll_unit_tests_ring", 3U, 0U, 0.0, false);
+    uint64_t read_index = reader->write_index();
+    write_frames(*writer, 0U, 3U);
+    EXPECT_EQ(0, read_frames(*reader, read_index, frames));
+    EXPECT_FALSE(reader->stale());
+
+    // Same size: the segment and its frame index are continued
+    writer = std::make_unique<t::shm::ring_t>
+        ("/dll_unit_tests_ring", 3U, 8U, 44100.0, true);
+    EXPECT_TRUE(reader->stale());
+    write_frames(*writer, 3U, 3U);
+    EXPECT_EQ(-1, read_frames(*reader, read_index, frames));
+    reader = std::make_unique<t::shm::ring_t>
+        ("/dll_unit_tests_ring", 3U, 0U, 0.0, false);
+    EXPECT_EQ(44100.0, reader->srate());
+    EXPECT_EQ(6U, reader->write_index());
+
+    // Other size: a new segment, the old mapping stays valid
+    writer = std::make_unique<t::shm::ring_t>
+        ("/dll_unit_tests_ring", 3U, 16U, 48000.0, true);
+    EXPECT_TRUE(reader->stale());
+    EXPECT_EQ(8U, reader->capacity());
+    EXPECT_EQ(-1, read_frames(*reader, read_index, frames));
+    reader = std::make_unique<t::shm::ring_t>
+        ("/dll_unit_tests_ring", 3U, 0U, 0.0, false);
+    EXPECT_FALSE(reader->stale());
+    EXPECT_EQ(16U, reader->capacity());
+    read_index = reader->write_index();
+    EXPECT_EQ(0U, read_index);
+    write_frames(*writer, 0U, 8U);
+    EXPECT_EQ(0, read_frames(*reader, read_index, frames));
+    EXPECT_EQ(8U, frames);
+    shm_unlink("/dll_unit_tests_ring");
+}
+
+TEST(timebase, one_writer_per_segment) {
+    const std::string name = "/dll_unit_tests_writer";
+    shm_unlink(name.c_str());
+    {
+        t::shm::timebase_t writer = {name, true};
+        EXPECT_THROW((t::shm::timebase_t{name, true}), std::runtime_error);
+        EXPECT_NO_THROW((t::shm::timebase_t{name, false}));
+    }
+    // The lock ends with the writer
+    EXPECT_NO_THROW((t::shm::timebase_t{name, true}));
+    shm_unlink(name.c_str());
+}
+
+TEST(timebase, writer_replaces_segment_of_other_size) {
+    const std::string name = "/dll_unit_tests_resized";
+    shm_unlink(name.c_str());
+    // A segment of an older layout, still mapped by a reader
+    const int old_fd = shm_open(name.c_str(), O_RDWR|O_CREAT|O_EXCL, 0644);
+    ASSERT_LE(0, old_fd);
+    ASSERT_EQ(0, ftruncate(old_fd, 4096));
+    {
+        t::shm::timebase_t writer = {name, true};
+        struct stat st;
+        ASSERT_EQ(0, fstat(old_fd, &st));
+        EXPECT_EQ(4096, st.st_size); // not truncated under the reader
+        t::shm::timebase_t reader = {name, false};
+        t::timing::timebase_snapshot_t s;
+        s.n1 = 96U;
+        writer.write(s);
+        EXPECT_TRUE(reader.read(s));
+        EXPECT_EQ(96U, s.n1);
+    }
+    close(old_fd);
+    shm_unlink(name.c_str());
+}
+
+TEST(timebase, readers_never_see_torn_snapshots) {
+    t::timing::timebase_seqlock_t seqlock;
+    seqlock.reset();
+    std::atomic<bool> done = {false};
+    std::thread writer([&] {
+        for (uint64_t k = 1U; k <= 200000U; ++k) {
+            t::timing::timebase_snapshot_t s;
+            s.t0 = k;
+            s.t1 = k + 1.0;
+            s.period = 1.0;
+            s.n0 = k * 96U;
+            s.n1 = s.n0 + 96U;
+            s.locked = k & 1U;
+            seqlock.write(s);
+        }
+        done = true;
+    });
+    uint64_t reads = 0U, torn = 0U, previous = 0U;
+    while (!done) {
+        t::timing::timebase_snapshot_t s;
+        if (!seqlock.read(s) || s.n1 == 0U)
+            continue;
+        ++reads;
+        const uint64_t k = s.n0 / 96U;
+        if (s.t0 != k || s.t1 != k + 1.0 || s.n1 != s.n0 + 96U ||
+            s.locked != (k & 1U) || s.sequence != 2U * k || k < previous)
+            ++torn;
+        previous = k;
+    }
+    writer.join();
+    EXPECT_GT(reads, 0U);
+    EXPECT_EQ(0U, torn);
+}
+
+TEST(ttiming, c_api_matches_plugin_filter) {
+    ttiming_params_t params;
+    ttiming_default_params(&params, 48000, 96);
+    params.estimator = "kalman";
+    EXPECT_EQ(nullptr, ttiming_check(&params));
+    std::vector<std::max_align_t> memory(ttiming_size() /
+                                         sizeof(std::max_align_t) + 1U);
+    EXPECT_EQ(nullptr, ttiming_init(memory.data(), ttiming_size() - 1U,
+                                    &params));
+    ttiming_t * timing = ttiming_init(memory.data(), ttiming_size(), &params);
+    ASSERT_NE(nullptr, timing);
+    const mhaconfig_t signal_dimensions =
+        {.channels=1, .domain=MHA_WAVEFORM, .fragsize=96, .wndlen=96,
+         .fftlen=192, .srate=48000};
+    t::plugins::dll::cfg_t cfg = {signal_dimensions, 0.2,
+                                  "CLOCK_REALTIME", 0, "none", 0.1, 2e-3,
+                                  "kalman"};
+    ttiming_state_t state;
+    ttiming_state(timing, &state);
+    EXPECT_FALSE(state.valid);
+    const double actual_tper = 96 / 48003.0;
+    double t0 = 0, t1 = 0;
+    for (unsigned k = 0; k < 5000U; ++k) {
+        const double time = 1.7e9 + k * actual_tper;
+        ttiming_process_at(timing, time, &t0, &t1);
+        ASSERT_EQ(cfg.process_at(time), std::make_pair(t0, t1)) << k;
+    }
+    ttiming_state(timing, &state);
+    EXPECT_TRUE(state.valid);
+    EXPECT_EQ(4999U * 96U, state.n0);
+    EXPECT_NEAR(48003.0, state.rate, 0.05);
+    // sample to time mapping and back
+    EXPECT_EQ(t1, ttiming_time_of(timing, state.n1));
+    EXPECT_NEAR(t0 + 48 / 48003.0, ttiming_time_of(timing, state.n0 + 48),
+                1e-6);
+    EXPECT_NEAR(state.n0 + 1e6, ttiming_sample_at(timing, ttiming_time_of(
+                    timing, state.n0 + 1e6)), 0.02);
+    // resume needs the same block size and sampling rate
+    std::vector<std::max_align_t> other_memory(memory.size());
+    ttiming_params_t other_params = params;
+    for (unsigned fragsize : {96U, 64U}) {
+        for (double srate : {48000.0, 44100.0}) {
+            other_params.fragsize = fragsize;
+            other_params.srate = srate;
+            ttiming_t * other = ttiming_init(other_memory.data(),
+                                             ttiming_size(), &other_params);
+            ASSERT_NE(nullptr, other);
+            const char * error = ttiming_resume(other, timing);
+            ttiming_state_t other_state;
+            ttiming_state(other, &other_state);
+            if (fragsize == 96U && srate == 48000.0) {
+                EXPECT_EQ(nullptr, error);
+                EXPECT_TRUE(other_state.valid);
+            } else {
+                EXPECT_NE(nullptr, error) << fragsize << " " << srate;
+                EXPECT_FALSE(other_state.valid) << fragsize << " " << srate;
+            }
+            ttiming_destroy(other);
+        }
+    }
+    // invalid parameters are rejected
+    params.prefilter = "invalid_name";
+    EXPECT_STREQ("unknown prefilter", ttiming_check(&params));
+    EXPECT_EQ(nullptr, ttiming_init(memory.data(), ttiming_size(), &params));
+    EXPECT_THROW((t::plugins::dll::cfg_t{signal_dimensions, 0.2,
+                                         "CLOCK_REALTIME", 0, "none", 0.1,
+                                         2e-3, "dll", "invalid_name"}),
+                 MHA_Error);
+    ttiming_destroy(timing);
+}
+
+TEST(playout, concealment_continues_periodic_audio) {
+    const double srate = 48000;
+    auto x = [&](unsigned n) {return 0.5 * sin(2 * M_PI * 440 * n / srate);};
+    t::plugins::playout::concealer_t concealer = {2U, srate, 0.04};
+    EXPECT_EQ(nullptr, concealer.missing()); // nothing to extrapolate
+    const unsigned start = 4800U, gap = 480U; // 10 ms lost
+    double error = 0.0, energy = 0.0, max_step = 0.0, previous = 0.0;
+    for (unsigned n = 0U; n < start + gap + 480U; ++n) {
+        // second channel inverted, must not cancel in the period search
+        const float frame[2] = {float(x(n)), -float(x(n))};
+        const float * y = (n >= start && n < start + gap)
+            ? concealer.missing() : concealer.received(frame);
+        ASSERT_NE(nullptr, y);
+        EXPECT_FLOAT_EQ(-y[0], y[1]);
+        if (n >= start && n < start + gap) {
+            error += (y[0] - x(n)) * (y[0] - x(n));
+            energy += x(n) * x(n);
+        }
+        if (n > start - 480U)
+            max_step = std::max(max_step, fabs(y[0] - previous));
+        previous = y[0];
+    }
+    EXPECT_GT(10 * log10(energy / error), 30.0); // silence: 0 dB
+    // no clicks at either end of the gap
+    EXPECT_LT(max_step, 1.25 * 0.5 * 2 * M_PI * 440 / srate);
+    // fades to silence after 40 ms
+    unsigned concealed = 0U;
+    while (concealer.missing())
+        ++concealed;
+    EXPECT_EQ(1920U, concealed);
+    // stays silent however long the gap lasts
+    for (unsigned n = 0U; n < 10000U; ++n)
+        ASSERT_EQ(nullptr, concealer.missing());
+    EXPECT_EQ(concealer.max_frames, concealer.gap_frames);
+}
+
+TEST(bands, band_energies_sum_the_bins_of_each_band) {
+    const mhaconfig_t d = {.channels=2, .domain=MHA_SPECTRUM, .fragsize=200,
+                           .wndlen=400, .fftlen=800, .srate=44100};
+    const std::vector<float> edges = {88, 177, 354, 707, 1414, 2828, 5657,
+                                      11314};
+    t::plugins::bands::band_energies_t bands = {d, edges};
+    ASSERT_EQ(7U, bands.bands);
+    MHASignal::spectrum_t s = {401U, 2U};
+    for (unsigned k = 0; k < 401U; ++k) {
+        value(&s, k, 0) = {0.0f, 0.0f};
+        value(&s, k, 1) = {float(k) / 400, 0.5f};
+    }
+    value(&s, 18U, 0) = {0.6f, -0.8f}; // 992 Hz, unit magnitude
+    const std::vector<float> & energies = bands.process(s);
+    ASSERT_EQ(14U, energies.size());
+    for (unsigned band = 0; band < 7U; ++band) {
+        EXPECT_FLOAT_EQ(band == 3U ? 1.0f : 0.0f, energies[band]);
+        double expected = 0.0;
+        for (unsigned k = 0; k < 401U; ++k) {
+            const double f = k * d.srate / d.fftlen;
+            if (f >= edges[band] && f < edges[band + 1U])
+                expected += std::norm(std::complex<double>
+                                      (value(&s, k, 1).re, value(&s, k, 1).im));
+        }
+        EXPECT_NEAR(expected, energies[7U + band], 1e-5 * expected);
+    }
+    EXPECT_THROW((t::plugins::bands::band_energies_t{d, {1000}}), MHA_Error);
+    EXPECT_THROW((t::plugins::bands::band_energies_t{d, {500, 500, 1000}}),
+                 MHA_Error);
+    // no band above the Nyquist frequency
+    EXPECT_THROW((t::plugins::bands::band_energies_t{d, {1000, 22100}}),
+                 MHA_Error);
+    EXPECT_NO_THROW((t::plugins::bands::band_energies_t{d, {1000, 22050}}));
+    const std::vector<float> octaves =
+        t::plugins::bands::band_energies_t::octave_edges(16000);
+    ASSERT_EQ(7U, octaves.size());
+    EXPECT_NEAR(88.39f, octaves.front(), 0.01f);
+    EXPECT_NEAR(5656.85f, octaves.back(), 0.01f);
+}
+
+TEST(bands, average_of_frames) {
+    t::plugins::bands::band_average_t average = {2U, 3U};
+    EXPECT_FALSE(average.add({1.0f, 2.0f}, 10.0));
+    EXPECT_FALSE(average.add({2.0f, 4.0f}, 11.0));
+    EXPECT_TRUE(average.add({3.0f, 6.0f}, 12.0));
+    EXPECT_FLOAT_EQ(2.0f, average.mean[0]);
+    EXPECT_FLOAT_EQ(4.0f, average.mean[1]);
+    EXPECT_DOUBLE_EQ(11.0, average.time);
+    // the next average starts over
+    EXPECT_FALSE(average.add({6.0f, 0.0f}, 13.0));
+    EXPECT_FALSE(average.add({6.0f, 0.0f}, 14.0));
+    EXPECT_TRUE(average.add({6.0f, 0.0f}, 15.0));
+    EXPECT_FLOAT_EQ(6.0f, average.mean[0]);
+    EXPECT_FLOAT_EQ(0.0f, average.mean[1]);
+    EXPECT_DOUBLE_EQ(14.0, average.time);
+}
+
+TEST(latency, loopback_measures_round_trip_with_sub_sample_precision) {
+    const mhaconfig_t signal_dimensions =
+        {.channels=2, .domain=MHA_WAVEFORM, .fragsize=96, .wndlen=96,
+         .fftlen=192, .srate=48000};
+    struct loopback_t {
+        double delay;     // round trip in samples, halves are interpolated
+        float polarity;
+        double input_share;
+        bool output_target;
+        double adjustment;
+    };
+    for (const loopback_t & loopback :
+             std::vector<loopback_t>{{1000.0, 1.0f, 0.5, true, 500.0},
+                                     {1000.5, -1.0f, 0.5, true, 500.25},
+                                     {3571.5, 1.0f, 0.25, false, -892.875}}) {
+        t::plugins::latency::cfg_t cfg = {signal_dimensions, 0U, 1U, 0.5f,
+                                          10U, 0.5, 0.2, 0.5,
+                                          loopback.input_share,
+                                          loopback.output_target};
+        MHASignal::waveform_t signal = {96U, 2U};
+        std::vector<float> played;
+        auto output = [&](double age) {
+            return age <= played.size() ?
+                played[played.size() - size_t(age)] : 0.0f;
+        };
+        // Channel 0 is looped back into channel 1
+        for (unsigned block = 0; block < 6000U; ++block) {
+            for (unsigned k = 0; k < 96U; ++k) {
+                const double age = loopback.delay - k;
+                signal.value(k, 1) = loopback.polarity * 0.5f *
+                    (output(std::floor(age)) + output(std::ceil(age)));
+            }
+            cfg.process(&signal);
+            for (unsigned k = 0; k < 96U; ++k)
+                played.push_back(signal.value(k, 0));
+            // The adjustment is published only after the last click
+            if (cfg.detected < 10U)
+                EXPECT_FALSE(cfg.complete()) << block;
+        }
+        EXPECT_TRUE(cfg.complete());
+        EXPECT_EQ(10U, cfg.detected) << loopback.delay;
+        EXPECT_GT(cfg.quality, 0.99) << loopback.delay;
+        EXPECT_NEAR(loopback.delay, cfg.latency() * 48000, 0.01);
+        EXPECT_NEAR(loopback.adjustment, cfg.adjustment() * 48000, 0.01);
+    }
+}
+
+TEST(syncmeter, history_keeps_room_for_the_unpublished_block) {
+    t::plugins::syncmeter::history_t history = {16U, 4U};
+    std::vector<float> local(16U), remote(16U);
+    for (unsigned k = 0; k < 20U; ++k)
+        history.append(k, -float(k), k);
+    history.publish(20U);
+    EXPECT_TRUE(history.latest(local.data(), remote.data(), 12U));
+    EXPECT_EQ(8.0f, local[0]);
+    EXPECT_EQ(-19.0f, remote[11]);
+    // The next block may overwrite the oldest samples while they are copied
+    EXPECT_FALSE(history.latest(local.data(), remote.data(), 13U));
+}
+
+TEST(syncmeter, measures_fractional_offset) {
+    const mhaconfig_t signal_dimensions =
+        {.channels=1, .domain=MHA_WAVEFORM, .fragsize=16, .wndlen=32,
+         .fftlen=64, .srate=1000};
+    MHAKernel::algo_comm_class_t algo_comm;
+    t::plugins::syncmeter::cfg_t cfg = {signal_dimensions, "local", 0U, 0.5,
+                                        0.1, 0.5, algo_comm.get_c_handle()};
+    // Low pass noise, the remote signal lags by 7.3 samples
+    std::mt19937 generator(2);
+    std::normal_distribution<float> noise;
+    std::vector<float> source(2000U);
+    for (size_t k = 1; k < source.size(); ++k)
+        source[k] = 0.7f * source[k - 1U] + 0.3f * noise(generator);
+    const double delay = 7.3;
+    std::vector<float> local(16U);
+    algo_comm.get_c_handle().insert_var("local", {MHA_AC_MHAREAL, 16U, 1U,
+                                                  local.data()});
+    MHASignal::waveform_t remote = {16U, 1U};
+    for (unsigned block = 0; block < 100U; ++block) {
+        for (unsigned k = 0; k < 16U; ++k) {
+            const unsigned index = block * 16U + k + 100U;
+            local[k] = source[index];
+            const double lagged = index - delay;
+            const unsigned before = unsigned(lagged);
+            const float fraction = lagged - before;
+            remote.value(k, 0) = (1.0f - fraction) * source[before] +
+                fraction * source[before + 1U];
+        }
+        cfg.process(&remote);
+    }
+    cfg.measure();
+    EXPECT_NEAR(delay / 1000, cfg.offset, 0.2e-3);
+    EXPECT_GT(cfg.quality, 0.9);
+}
+
+TEST(drift, regression_estimates_rate_ratio_and_phase) {
+    const mhaconfig_t signal_dimensions =
+        {.channels=1, .domain=MHA_WAVEFORM, .fragsize=96, .wndlen=96,
+         .fftlen=192, .srate=48000};
+    MHAKernel::algo_comm_class_t algo_comm;
+    auto & ac = algo_comm.get_c_handle();
+    t::plugins::timebase::publisher_t timebase_a = {ac, "a_timebase"},
+        timebase_b = {ac, "b_timebase"};
+    t::plugins::drift::cfg_t cfg = {signal_dimensions, "a", "b", 1.0, ac};
+    cfg.process();
+    EXPECT_TRUE(std::isnan(cfg.ratio)); // nothing published yet
+    // Stream b runs 50 ppm fast in blocks of 64 samples and has sample
+    // index 1234.5 when stream a starts.  Its dll times jitter by 1 us.
+    const double start = 1000.0, rate_a = 48000.0, rate_b = 48000 * 1.00005;
+    const double phase = 1234.5;
+    std::mt19937 generator(1);
+    std::normal_distribution<double> jitter(0.0, 1e-6);
+    t::timing::timebase_snapshot_t a, b;
+    a.period = 96 / rate_a;
+    b.period = 64 / rate_b;
+    for (unsigned block = 0; block < 10000U; ++block) {
+        a.n0 = block * 96U;
+        a.n1 = a.n0 + 96U;
+        a.t0 = start + a.n0 / rate_a;
+        a.t1 = a.t0 + a.period;
+        // Latest block of b that started before the block of a
+        b.n0 = uint64_t(std::floor((phase + a.n0 * rate_b / rate_a) / 64)) * 64;
+        b.n1 = b.n0 + 64U;
+        b.t0 = start + (b.n0 - phase) / rate_b + jitter(generator);
+        b.t1 = b.t0 + b.period;
+        timebase_a.write(a);
+        timebase_b.write(b);
+        cfg.process();
+        if (block == 0U)
+            EXPECT_NEAR(1.00005, cfg.ratio, 1e-3);
+    }
+    EXPECT_NEAR(1.00005, cfg.ratio, 1e-6);
+    EXPECT_NEAR(phase + a.n0 * rate_b / rate_a, cfg.position, 0.05);
+    // A dll that restarts publishes an empty time base first
+    timebase_b.write(t::timing::timebase_snapshot_t());
+    cfg.process();
+    EXPECT_TRUE(std::isnan(cfg.ratio));
+    EXPECT_TRUE(std::isnan(cfg.position));
+}
+
 // Local variables:
 // compile-command: "make unit-tests"
 // c-basic-offset: 4
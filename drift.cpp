@@ -0,0 +1,107 @@
+#include "drift.hh"
+#include "trace.hh"
+
+namespace t::plugins::drift {
+
+    class if_t : public MHAPlugin::plugin_t<cfg_t>
+    {
+    public:
+        /** Constructor publishes the result AC variables.
+         * @param algo_comm AC variable space
+         * @param configured_name Loaded name of plugin, used as AC variable
+         *        base name */
+        if_t(algo_comm_t & algo_comm, const std::string & configured_name)
+            : MHAPlugin::plugin_t<cfg_t>("Estimates rate ratio and phase of"
+                                         " two independent clocks from two"
+                                         " dll plugins, publishes AC"
+                                         " variables " + configured_name +
+                                         "_ratio and " + configured_name +
+                                         "_position",
+                                         algo_comm)
+            , ratio(algo_comm, configured_name + "_ratio",
+                    std::numeric_limits<double>::quiet_NaN())
+            , position(algo_comm, configured_name + "_position",
+                       std::numeric_limits<double>::quiet_NaN())
+        {
+            insert_member(dll_a);
+            patchbay.connect(&dll_a.writeaccess, this, &if_t::update);
+            insert_member(dll_b);
+            patchbay.connect(&dll_b.writeaccess, this, &if_t::update);
+            insert_member(time_constant);
+            patchbay.connect(&time_constant.writeaccess, this, &if_t::update);
+        }
+
+        /** Process callback, signal is not modified.
+         * @return unmodified pointer to input signal */
+        template<class mha_signal_t>
+        mha_signal_t * process(mha_signal_t * s) {
+            T_TRACE_SCOPE("drift.process");
+            cfg_t * cfg = poll_config();
+            cfg->process();
+            ratio.data = cfg->ratio;
+            position.data = cfg->position;
+            return s;
+        }
+        /** Prepare for signal processing. */
+        void prepare(mhaconfig_t & /*signal_dimensions*/) {
+            ratio.data = position.data =
+                std::numeric_limits<double>::quiet_NaN();
+            update();
+        }
+        /** Empty implementation of release. */
+        void release() {}
+
+        /** Connects configuration events to actions. */
+        MHAEvents::patchbay_t<if_t> patchbay;
+
+        /** Rate ratio rate_b / rate_a, published as AC variable */
+        MHA_AC::double_t ratio;
+
+        /** Fractional sample index of stream b that coincides with the
+         * first sample of the current block of stream a, published as AC
+         * variable */
+        MHA_AC::double_t position;
+
+        MHAParser::string_t dll_a =
+            {"Name of the reference dll plugin", "dll"};
+
+        MHAParser::string_t dll_b =
+            {"Name of the dll plugin of the other clock", "dll_b"};
+
+        MHAParser::float_t time_constant =
+            {"Time constant of the exponentially weighted regression in s",
+             "10", "]0,]"};
+
+        virtual void update(void) {
+            if (is_prepared())
+                push_config(new cfg_t(input_cfg(),
+                                      dll_a.data,
+                                      dll_b.data,
+                                      time_constant.data,
+                                      ac));
+        }
+    };
+}
+
+MHAPLUGIN_CALLBACKS(drift,t::plugins::drift::if_t,wave,wave)
+MHAPLUGIN_PROC_CALLBACK(drift,t::plugins::drift::if_t,spec,spec)
+
+MHAPLUGIN_DOCUMENTATION\
+(drift,
+ "acvariables time",
+ "Estimates the relative sampling rate and the phase of two independently"
+ " clocked audio streams, e.g. two sound cards or a sound card and a"
+ " network stream, each of which is timed by its own dll plugin.  The"
+ " sample index of stream b at the start of each block of stream a is"
+ " regressed on the sample index of stream a with exponential forgetting."
+ " The slope is published as AC variable <name>_ratio (rate_b/rate_a), the"
+ " regression value as <name>_position (fractional sample index of stream"
+ " b), ready to drive an asynchronous sample rate converter."
+ )
+
+// Local variables:
+// compile-command: "make"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
@@ -0,0 +1,111 @@
+#include <cmath>
+#include <limits>
+#include <string>
+#include <mha_plugin.hh>
+#include "ac_timebase.hh"
+
+namespace t::plugins::drift {
+
+    /** Runtime configuration class of MHA plugin which estimates the
+        relative rate and phase of two independently clocked streams from
+        the time bases of two dll plugins. */
+    class cfg_t {
+    public:
+        /** Constructor
+         * @param signal_dimensions fragsize, srate of the stream in which
+         *        this plugin runs
+         * @param dll_a_name configured name of the reference dll
+         * @param dll_b_name configured name of the other dll
+         * @param time_constant Time constant of the exponentially weighted
+         *        regression in seconds */
+        cfg_t(const mhaconfig_t & signal_dimensions,
+              const std::string & dll_a_name,
+              const std::string & dll_b_name,
+              double time_constant,
+              algo_comm_t & ac)
+            : timebase_a(ac, dll_a_name, signal_dimensions.fragsize)
+            , timebase_b(ac, dll_b_name, signal_dimensions.fragsize)
+            , alpha(1 - exp(-double(signal_dimensions.fragsize) /
+                            (signal_dimensions.srate * time_constant)))
+        {
+        }
+
+        virtual ~cfg_t() = default;
+
+        /** Time bases <dll>_timebase of dll a and dll b, each read as one
+         * consistent snapshot although dll b typically runs in another
+         * thread */
+        timebase::reader_t timebase_a, timebase_b;
+
+        /** Weight of the newest observation in the regression */
+        const double alpha;
+
+        /** Observations since last reset */
+        uint64_t count = {0U};
+
+        /** Sample index of dll a in the previous block, detects restarts */
+        uint64_t last_n0_a = {0U}, last_n0_b = {0U};
+
+        /** Exponentially weighted means of the sample indices of a and b */
+        double mean_a = {0.0}, mean_b = {0.0};
+
+        /** Exponentially weighted (co)variance of the sample indices */
+        double var_a = {0.0}, cov_ab = {0.0};
+
+        /** Estimated rate ratio rate_b / rate_a */
+        double ratio = std::numeric_limits<double>::quiet_NaN();
+
+        /** Estimated sample index of stream b coinciding with the first
+         * sample of the current block of stream a */
+        double position = std::numeric_limits<double>::quiet_NaN();
+
+        /** Reads the dlls, updates the regression of the sample index of
+         * stream b over the sample index of stream a. */
+        virtual void process() {
+            t::timing::timebase_snapshot_t a, b;
+            if (!timebase_a.latest(a) || !timebase_b.latest(b) ||
+                !valid(a) || !valid(b)) {
+                ratio = position = std::numeric_limits<double>::quiet_NaN();
+                count = 0U;
+                return;
+            }
+            // Restart of either dll: the sample indices start over
+            if (a.n0 < last_n0_a || b.n0 < last_n0_b)
+                count = 0U;
+            last_n0_a = a.n0;
+            last_n0_b = b.n0;
+            const double x = a.n0;
+            const double y = b.sample_at(a.t0);
+            if (count == 0U) {
+                mean_a = x;
+                mean_b = y;
+                var_a = cov_ab = 0.0;
+            } else {
+                const double dx = x - mean_a, dy = y - mean_b;
+                mean_a += alpha * dx;
+                mean_b += alpha * dy;
+                var_a = (1 - alpha) * (var_a + alpha * dx * dx);
+                cov_ab = (1 - alpha) * (cov_ab + alpha * dx * dy);
+            }
+            ++count;
+            // Until the regression has seen enough blocks, use the ratio of
+            // the instantaneous rates estimated by the dlls
+            if (count * alpha < 1.0 || var_a <= 0.0)
+                ratio = b.rate() / a.rate();
+            else
+                ratio = cov_ab / var_a;
+            position = mean_b + ratio * (x - mean_a);
+        }
+        /** @return true if the snapshot maps times to sample indices */
+        static bool valid(const t::timing::timebase_snapshot_t & s) {
+            return std::isfinite(s.t0) && std::isfinite(s.period) &&
+                s.period > 0.0 && s.n1 > s.n0;
+        }
+    };
+}
+// Local variables:
+// compile-command: "make"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
@@ -0,0 +1,140 @@
+// Compares accuracy and CPU cost of the timing estimators in estimators.hh
+// on recorded timestamps, e.g. the captures in sample_data.  The reference
+// is the straight line fitted post-hoc through all timestamps of the file
+// with linear regression, see sample_data/README.md.  For every estimator,
+// the deviation of the filtered times from this line is reported after a
+// settling time, together with the mean computation time per block.
+//
+// The timestamps are read as text, one per line.  Export them from the
+// .mat files with Octave:
+//   load bpi-r48-p96.mat; dlmwrite("bpi-r48-p96.txt",timestamper,"precision","%.9f")
+// Usage:
+//   ./compare-estimators file.txt [srate fragsize bandwidth settle_seconds]
+
+#include "estimators.hh"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace timing = t::timing;
+
+namespace {
+    struct result_t {
+        double rms, max, ns_per_block;
+    };
+
+    /** Filters all timestamps with the estimator, compares the filtered
+     * times after the settling time with the reference line. */
+    template<class estimator_t>
+    result_t evaluate(estimator_t estimator, timing::prefilter_t prefilter,
+                      const std::vector<double> & times,
+                      uint64_t nper, double tper, size_t settle,
+                      double intercept, double slope)
+    {
+        std::vector<double> filtered(times.size());
+        timing::loop_state_t state;
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t k = 0; k < times.size(); ++k)
+            filtered[k] = timing::filter_time_with(estimator, prefilter,
+                                                   state, times[k], nper,
+                                                   tper);
+        const auto stop = std::chrono::steady_clock::now();
+        double sum2 = 0.0, max = 0.0;
+        for (size_t k = settle; k < times.size(); ++k) {
+            const double deviation =
+                filtered[k] - (times[0] + intercept + slope * k);
+            sum2 += deviation * deviation;
+            max = std::max(max, std::fabs(deviation));
+        }
+        const size_t count = times.size() - settle;
+        return {std::sqrt(sum2 / count), max,
+                std::chrono::duration<double, std::nano>(stop - start).count()
+                / times.size()};
+    }
+
+    void print(const char * name, const char * prefilter,
+               const result_t & r) {
+        std::printf("%-8s %-10s %12.2f %12.2f %14.1f\n",
+                    name, prefilter, r.rms * 1e6, r.max * 1e6,
+                    r.ns_per_block);
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc != 2 && argc != 6) {
+        std::fprintf(stderr, "usage: %s timestamps.txt"
+                     " [srate fragsize bandwidth settle_seconds]\n", argv[0]);
+        return 1;
+    }
+    const double srate = argc == 6 ? std::atof(argv[2]) : 48000.0;
+    const uint64_t nper = argc == 6 ? std::atoi(argv[3]) : 96U;
+    const double tper = nper / srate;
+    const double F = 1 / tper;
+    const double B = argc == 6 ? std::atof(argv[4]) : 19.2 / nper;
+    const double settle_seconds = argc == 6 ? std::atof(argv[5]) : 2.0;
+
+    std::vector<double> times;
+    std::ifstream file(argv[1]);
+    for (std::string line; std::getline(file, line);)
+        if (!line.empty())
+            times.push_back(std::strtod(line.c_str(), nullptr));
+    const size_t settle = size_t(settle_seconds * F);
+    if (times.size() <= settle + 2U) {
+        std::fprintf(stderr, "%s: too few timestamps\n", argv[1]);
+        return 1;
+    }
+
+    // Post-hoc reference line through all timestamps, relative to the
+    // first timestamp to preserve precision
+    double Sx = 0, Sy = 0, Sxx = 0, Sxy = 0;
+    const double N = times.size();
+    for (size_t k = 0; k < times.size(); ++k) {
+        const double y = times[k] - times[0];
+        Sx += k; Sy += y; Sxx += double(k) * k; Sxy += k * y;
+    }
+    const double slope = (N * Sxy - Sx * Sy) / (N * Sxx - Sx * Sx);
+    const double intercept = (Sy - slope * Sx) / N;
+
+    std::printf("%s: %zu blocks, estimated srate %.3f Hz, bandwidth %g Hz,"
+                " settling %zu blocks\n",
+                argv[1], times.size(), nper / slope, B, settle);
+    std::printf("%-8s %-10s %12s %12s %14s\n",
+                "", "prefilter", "rms/us", "max/us", "ns/block");
+    const double omega = 2 * M_PI * B / F;
+    const struct {
+        const char * name;
+        timing::prefilter_t prefilter;
+    } prefilters[] = {
+        {"none", {timing::prefilter_t::NONE, 0.0, B / F}},
+        {"pair", {timing::prefilter_t::PAIR, 0.0, B / F}},
+        {"median3", {timing::prefilter_t::MEDIAN3, 0.0, B / F}},
+        {"median5", {timing::prefilter_t::MEDIAN5, 0.0, B / F}},
+        {"none+clip", {timing::prefilter_t::NONE, 3.0, B / F}},
+        {"pair+clip", {timing::prefilter_t::PAIR, 3.0, B / F}},
+    };
+    for (const auto & p : prefilters)
+        print("dll", p.name,
+              evaluate(timing::dll_estimator_t(sqrt(2) * omega, omega * omega),
+                       p.prefilter, times, nper, tper, settle,
+                       intercept, slope));
+    for (const auto & p : prefilters)
+        print("kalman", p.name,
+              evaluate(timing::kalman_estimator_t(omega, tper), p.prefilter,
+                       times, nper, tper, settle, intercept, slope));
+    for (const auto & p : prefilters)
+        print("rls", p.name,
+              evaluate(timing::rls_estimator_t(F / (2 * B)), p.prefilter,
+                       times, nper, tper, settle, intercept, slope));
+    return 0;
+}
+
+// Local variables:
+// compile-command: "make compare-estimators"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
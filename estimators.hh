@@ -0,0 +1,447 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+namespace t::timing {
+
+    /** State of the time filter that is common to all estimators. */
+    struct loop_state_t {
+        /** Measured time of the first block.  The loop runs on times
+         * relative to the epoch: Absolute clock times of about 1.6e9 s
+         * would limit the resolution of the accumulated times to 0.24 us.*/
+        double epoch = {0.0};
+
+        /** actual duration of 1 block of audio, in seconds.
+         * Initialized to nominal block duration at startup and after
+         * dropouts, then adapted to measured duration by the dll. */
+        double e2;
+
+        /** start time of the current block as predicted by the dll,
+         * relative to epoch. */
+        double t0;
+
+        /** start time of the next block as predicted by the dll,
+         * relative to epoch. */
+        double t1;
+
+        /** Total sample index of first sample in current block.
+         * Reset to zero for every dropout. */
+        uint64_t n0 = {0U};
+
+        /** Total sample index of first sample in next block.
+         * Reset to zero for every dropout. */
+        uint64_t n1 = {0U};
+
+        /** Difference between measured and predicted time. Adapts loop.*/
+        double e;
+    };
+
+    /** Timing estimator policies.  Each estimator provides
+     *   void init(loop_state_t & s, double unfiltered_time, double tper);
+     *   void update(loop_state_t & s, double unfiltered_time);
+     *   void resume(const loop_state_t & s, double tper);
+     *   void retune(const loop_state_t & s, double omega, double tper);
+     * init sets t0, t1 and e2 for the first block.  resume prepares the
+     * estimator to continue a locked loop state that was computed by
+     * another estimator instance, e.g. before a parameter change.  retune
+     * changes the normalized bandwidth omega = 2piB/F of a running
+     * estimator without changing the loop state.  update sets e from the
+     * new measurement, moves the prediction t1 to t0, and predicts t1 and
+     * e2 for the next block.  All times are relative to the epoch.  The
+     * epoch and the sample indices are maintained by filter_time_with().
+     * All member functions are defined inline so that the selected policy
+     * is inlined into the processing callback. */
+
+    /** Second order delay-locked loop as described in
+        Fons Adriensen: Using a DLL to filter time. 2005. */
+    class dll_estimator_t {
+    public:
+        /** @param b 1st order parameter, sqrt(2)2piB/F
+         *  @param c 2nd order parameter, (2piB/F)^2 */
+        dll_estimator_t(double b, double c) : b(b), c(c) {}
+        double b, c;
+        void init(loop_state_t & s, double unfiltered_time, double tper) {
+            s.e2 = tper;
+            s.t0 = unfiltered_time;
+            s.t1 = s.t0 + s.e2;
+        }
+        void update(loop_state_t & s, double unfiltered_time) {
+            s.e = unfiltered_time - s.t1;
+            s.t0 = s.t1;
+            s.t1 += b*s.e + s.e2;
+            s.e2 += c*s.e;
+        }
+        void resume(const loop_state_t &, double) {}
+        void retune(const loop_state_t &, double omega, double) {
+            b = std::sqrt(2.0) * omega;
+            c = omega * omega;
+        }
+    };
+
+    /** Two-state Kalman filter.  The state is the start time of the next
+     * block and the block duration, the block duration performs a random
+     * walk.  The ratio of process noise to measurement noise is chosen so
+     * that the steady state gains approximate those of the dll with the
+     * same bandwidth, while the gains are larger during acquisition. */
+    class kalman_estimator_t {
+    public:
+        /** @param omega 2piB/F, normalized loop bandwidth
+         *  @param tper nominal block duration in seconds */
+        kalman_estimator_t(double omega, double tper)
+            : R(tper * tper)
+            , q(omega * omega * omega * omega * R)
+        {
+            // Steady state covariance for resume(): iterate the Riccati
+            // equation of update() until it converges.
+            loop_state_t s = {};
+            init(s, 0.0, tper);
+            for (unsigned k = 0; k < 1000000U; ++k) {
+                const double P00_previous = P00;
+                update(s, s.t1);
+                if (std::fabs(P00 - P00_previous) <= 1e-12 * P00)
+                    break;
+            }
+            steady_P00 = P00;
+            steady_P01 = P01;
+            steady_P11 = P11;
+        }
+        /** Measurement noise variance, normalized to block duration */
+        double R;
+        /** Process noise variance of the block duration per block */
+        double q;
+        /** Covariance of the predicted state (t1, e2) */
+        double P00 = {0.0}, P01 = {0.0}, P11 = {0.0};
+        /** Steady state covariance of the predicted state */
+        double steady_P00, steady_P01, steady_P11;
+        void init(loop_state_t & s, double unfiltered_time, double tper) {
+            s.e2 = tper;
+            s.t0 = unfiltered_time;
+            s.t1 = s.t0 + s.e2;
+            // covariance diag(R,R) of (t0, e2) predicted to the next block
+            P00 = 2*R;
+            P01 = R;
+            P11 = R;
+        }
+        void update(loop_state_t & s, double unfiltered_time) {
+            s.e = unfiltered_time - s.t1;
+            s.t0 = s.t1;
+            const double S = P00 + R;
+            const double K0 = P00 / S, K1 = P01 / S;
+            // a posteriori state and covariance
+            const double t = s.t1 + K0 * s.e;
+            s.e2 += K1 * s.e;
+            const double p00 = (1 - K0) * P00;
+            const double p01 = (1 - K0) * P01;
+            const double p11 = P11 - K1 * P01;
+            // prediction for the next block
+            s.t1 = t + s.e2;
+            P00 = p00 + 2*p01 + p11;
+            P01 = p01 + p11;
+            P11 = p11 + q;
+        }
+        void resume(const loop_state_t &, double) {
+            P00 = steady_P00;
+            P01 = steady_P01;
+            P11 = steady_P11;
+        }
+        /** The covariance converges to the new steady state by itself */
+        void retune(const loop_state_t &, double omega, double) {
+            q = omega * omega * omega * omega * R;
+        }
+    };
+
+    /** Least-squares fit of a straight line through the measured times of
+     * the most recent blocks (sliding window), extrapolated to the next
+     * block.  Sums are updated recursively, O(1) per block.  The residuals
+     * are kept as sums over buckets of D consecutive blocks, so that the
+     * state stays small for any window: up to 127 blocks, D is 1 and the
+     * window is exact; longer windows drop their oldest bucket as a whole
+     * and hold between W - D + 1 and W blocks, i.e. they vary by less
+     * than 1%. */
+    class rls_estimator_t {
+    public:
+        /** Longest supported window in blocks */
+        static constexpr unsigned max_window = 8192U;
+        /** Number of buckets in the ring */
+        static constexpr unsigned buckets = 128U;
+        /** @param window number of blocks in the window, limited to
+         *         2..max_window */
+        explicit rls_estimator_t(double window)
+        {
+            set_window(window);
+        }
+        /** Number of blocks in the window */
+        unsigned W;
+        /** Blocks per bucket */
+        unsigned D;
+        /** Nominal block duration and time of the first block.  Residuals
+         * against this nominal timeline are fitted to preserve precision. */
+        double tper = {0.0}, t_first = {0.0};
+        /** Blocks since init */
+        uint64_t k = {0U};
+        /** Number of residuals in the window */
+        unsigned n = {0U};
+        /** Sums of residuals y and of x*y, where x is the block position
+         * relative to the newest block (0, -1, -2, ...) */
+        double Sy = {0.0}, Sxy = {0.0};
+        /** Sums of the residuals y of the blocks in bucket k / D, and of
+         * (k % D) * y, ring buffer */
+        std::array<double, buckets> By, Bjy;
+        void init(loop_state_t & s, double unfiltered_time, double tper) {
+            this->tper = tper;
+            t_first = unfiltered_time;
+            k = 0U;
+            n = 1U;
+            Sy = Sxy = 0.0;
+            By[0] = Bjy[0] = 0.0;
+            s.e2 = tper;
+            s.t0 = unfiltered_time;
+            s.t1 = s.t0 + s.e2;
+        }
+        void update(loop_state_t & s, double unfiltered_time) {
+            s.e = unfiltered_time - s.t1;
+            s.t0 = s.t1;
+            ++k;
+            const double y_new = unfiltered_time - (t_first + k * tper);
+            // The oldest bucket leaves the window, its first block k - 1 - n
+            // has position 1 - n relative to the previous block
+            if (n == W) {
+                const unsigned bucket = ((k - n) / D) % buckets;
+                Sxy -= Bjy[bucket] + (1.0 - n) * By[bucket];
+                Sy -= By[bucket];
+                n -= D;
+            }
+            // All residuals in the window move one position back
+            Sxy -= Sy;
+            Sy += y_new;
+            add(k, y_new);
+            ++n;
+            // x = 0, -1, ..., 1-n:  sum x = -n(n-1)/2, sum x^2 = (n-1)n(2n-1)/6
+            const double N = n;
+            const double Sx = -N * (N - 1) / 2;
+            const double Sxx = (N - 1) * N * (2 * N - 1) / 6;
+            const double slope = (Sxy - Sx * Sy / N) / (Sxx - Sx * Sx / N);
+            const double intercept = (Sy - slope * Sx) / N;
+            s.e2 = tper + slope;
+            s.t1 = t_first + (k + 1) * tper + intercept + slope;
+        }
+        /** Fills the window with the line of the loop state: next block at
+         * t1, block duration e2.  O(W), once per reconfiguration. */
+        void resume(const loop_state_t & s, double tper) {
+            this->tper = tper;
+            k = W - 1U;
+            n = W;
+            t_first = s.t1 - (k + 1) * tper;
+            Sy = Sxy = 0.0;
+            for (unsigned block = 0; block <= k; ++block) {
+                // residual of block against the nominal timeline
+                const unsigned back = k - block;
+                const double residual = (back + 1) * (tper - s.e2);
+                Sy += residual;
+                Sxy -= back * residual;
+                add(block, residual);
+            }
+        }
+        /** New window of pi/omega blocks, i.e. F/(2B), filled with the
+         * current line.  O(W). */
+        void retune(const loop_state_t & s, double omega, double tper) {
+            const unsigned window = unsigned(
+                std::clamp(M_PI / omega, 2.0, double(max_window)));
+            if (window == W)
+                return;
+            set_window(window);
+            resume(s, tper);
+        }
+
+    private:
+        void set_window(double window) {
+            W = unsigned(std::clamp(window, 2.0, double(max_window)));
+            // The partly filled newest bucket needs one more
+            D = (W + buckets - 2U) / (buckets - 1U);
+        }
+        /** Adds the residual of a block to its bucket */
+        void add(uint64_t block, double y) {
+            const unsigned bucket = (block / D) % buckets;
+            if (block % D == 0U)
+                By[bucket] = Bjy[bucket] = 0.0;
+            By[bucket] += y;
+            Bjy[bucket] += (block % D) * y;
+        }
+    };
+
+    /** Robust pre-filter applied to the measured times before the
+     * estimator.  The last few measurements are projected onto the current
+     * block with the estimated block duration and combined:
+     * pair averages the last two, which cancels the alternating
+     * quantization of the callback times on many boards, median3 and
+     * median5 take the median and reject isolated outliers.  Optionally,
+     * the remaining error against the prediction is clipped to clip
+     * standard deviations of the observed error.  O(1) per block. */
+    class prefilter_t {
+    public:
+        enum mode_t {NONE, PAIR, MEDIAN3, MEDIAN5};
+        /** Longest history in blocks */
+        static constexpr unsigned max_history = 5U;
+        /** @param mode how the recent measurements are combined
+         *  @param clip clipping threshold in standard deviations, 0: off
+         *  @param alpha weight of the newest error in the variance */
+        prefilter_t(mode_t mode, double clip, double alpha)
+            : history(mode == PAIR ? 2U : mode == MEDIAN3 ? 3U :
+                      mode == MEDIAN5 ? 5U : 1U)
+            , clip(clip), alpha(alpha)
+        {}
+        /** Number of measurements combined */
+        const unsigned history;
+        const double clip;
+        const double alpha;
+        /** Exponentially weighted variance of the error */
+        double variance = {0.0};
+        /** Blocks since init */
+        uint64_t count = {0U};
+        /** Recent measurements, ring buffer */
+        std::array<double, max_history> times;
+
+        /** @param unfiltered_time measured time of the current block,
+         *         relative to the epoch
+         *  @param s loop state before the estimator update
+         * @return the time to pass to the estimator */
+        double process(double unfiltered_time, const loop_state_t & s) {
+            if (s.n1 == 0U) {
+                count = 0U;
+                variance = 0.0;
+            }
+            ++count;
+            if (history == 1U && clip <= 0.0)
+                return unfiltered_time;
+            times[(count - 1U) % max_history] = unfiltered_time;
+            if (count == 1U)
+                return unfiltered_time;
+            unsigned n = unsigned(std::min<uint64_t>(count, history));
+            if (history >= 3U && (n & 1U) == 0U)
+                --n; // median of an odd number of measurements
+            double projected[max_history];
+            for (unsigned back = 0; back < n; ++back)
+                projected[back] = times[(count - 1U - back) % max_history]
+                    + back * s.e2;
+            double combined;
+            if (n == 2U)
+                combined = (projected[0] + projected[1]) / 2;
+            else if (n >= 3U) {
+                std::nth_element(projected, projected + n/2, projected + n);
+                combined = projected[n/2];
+            } else
+                combined = projected[0];
+            double e = combined - s.t1;
+            if (clip > 0.0) {
+                const double limit = clip * std::sqrt(variance);
+                // Clip only when the variance estimate has settled
+                if (count * alpha > 1.0)
+                    e = std::clamp(e, -limit, limit);
+                // Variance follows the clipped error, so that a lasting
+                // change of the error grows the limit until it is tracked
+                const double weight = std::max(alpha, 1.0 / count);
+                variance += weight * (e * e - variance);
+            }
+            return s.t1 + e;
+        }
+    };
+
+    /** Tunes the loop bandwidth online to the noise of the measured times.
+     * Noise model: white jitter on the measured times and a random walk
+     * of the block duration (wander and drift of the sound card clock).
+     * With the optimal bandwidth for this model the loop error e is white:
+     * wander that a too narrow loop does not follow makes e correlated
+     * over the time constant 1/omega of the loop, jitter that a too wide
+     * loop passes on makes it anti-correlated.  The tuner compares the
+     * variance of e averaged over windows of M = 1/omega blocks with the
+     * variance v/M expected for white e, and moves omega by a power of the
+     * ratio after every window.  O(1) per block. */
+    class bandwidth_tuner_t {
+    public:
+        /** @param omega_min lower bound of the normalized bandwidth
+         *  @param omega_max upper bound of the normalized bandwidth
+         *  @param alpha weight of a new block in the noise estimates,
+         *         1/(tuning time * F) */
+        explicit bandwidth_tuner_t(double omega_min = 0.0,
+                                   double omega_max = 0.0,
+                                   double alpha = 0.0)
+            : omega_min(omega_min), omega_max(omega_max), alpha(alpha)
+        {}
+        double omega_min, omega_max, alpha;
+        /** Exponent of the variance ratio in the bandwidth update */
+        static constexpr double gain = 0.5;
+        /** Largest change of the bandwidth per window */
+        static constexpr double max_ratio = 1.25;
+        /** Variance of the loop error, approximately the jitter variance
+         * of the measured times / s^2 */
+        double variance = {0.0};
+        /** Variance of the loop error averaged over a window / s^2 */
+        double window_variance = {0.0};
+        /** Blocks and windows evaluated */
+        uint64_t count = {0U}, windows = {0U};
+        /** Length of the current window, blocks in it, sum of the errors */
+        uint64_t M = {0U}, in_window = {0U};
+        double sum = {0.0};
+
+        /** @param e loop error of the current block
+         *  @param omega normalized bandwidth of the loop
+         *  @return the normalized bandwidth for the next block */
+        double process(double e, double omega) {
+            // Acquisition of lock is not noise: the statistics start after
+            // the first tuning time
+            if (++count * alpha <= 1.0)
+                return omega;
+            const double n = count - 1 / alpha;
+            variance += std::max(alpha, 1.0 / n) * (e * e - variance);
+            if (in_window == 0U)
+                M = uint64_t(std::clamp(std::round(1 / omega), 2.0, 1e6));
+            sum += e;
+            if (++in_window < M)
+                return omega;
+            const double mean = sum / M;
+            ++windows;
+            window_variance += std::max(std::min(1.0, alpha * M),
+                                        1.0 / windows) *
+                (mean * mean - window_variance);
+            in_window = 0U;
+            sum = 0.0;
+            if (n * alpha > 1.0 && variance > 0.0) {
+                const double ratio = M * window_variance / variance;
+                omega *= std::clamp(std::pow(ratio, gain),
+                                    1 / max_ratio, max_ratio);
+                omega = std::clamp(omega, omega_min, omega_max);
+            }
+            return omega;
+        }
+    };
+
+    /** Filters the input time with the given pre-filter and estimator
+     * policy and advances the sample indices.
+     * @return the filtered start time of the current block */
+    template<class estimator_t>
+    inline double filter_time_with(estimator_t & estimator,
+                                   prefilter_t & prefilter, loop_state_t & s,
+                                   double unfiltered_time,
+                                   uint64_t nper, double tper)
+    {
+        if (s.n1 == 0U) {
+            s.epoch = unfiltered_time;
+            prefilter.process(0.0, s);
+            estimator.init(s, 0.0, tper);
+            s.n0 = 0;
+            s.n1 = nper;
+            return s.epoch + s.t0;
+        }
+        estimator.update(s, prefilter.process(unfiltered_time - s.epoch, s));
+        s.n0 = s.n1;
+        s.n1 += nper;
+        return s.epoch + s.t0;
+    }
+}
+// Local variables:
+// compile-command: "make timing-library"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
@@ -0,0 +1,172 @@
+#include "latency.hh"
+#include "trace.hh"
+
+namespace t::plugins::latency {
+
+    class if_t : public MHAPlugin::plugin_t<cfg_t>
+    {
+    public:
+        /** Constructor publishes the result AC variables.
+         * @param algo_comm AC variable space
+         * @param configured_name Loaded name of plugin, used as AC variable
+         *        base name */
+        if_t(algo_comm_t & algo_comm, const std::string & configured_name)
+            : MHAPlugin::plugin_t<cfg_t>("Measures the round trip latency"
+                                         " through a loopback cable from"
+                                         " output_channel to input_channel"
+                                         " with clicks and publishes AC"
+                                         " variables " + configured_name +
+                                         "_latency (s), " + configured_name +
+                                         "_spread (s), " + configured_name +
+                                         "_clicks and " + configured_name +
+                                         "_adjustment (s), which plugin dll"
+                                         " adds to its times when its"
+                                         " adjustment_source names it.  A new"
+                                         " calibration starts with every"
+                                         " parameter change.",
+                                         algo_comm)
+            , latency_ac(algo_comm, configured_name + "_latency",
+                         std::numeric_limits<double>::quiet_NaN())
+            , spread_ac(algo_comm, configured_name + "_spread",
+                        std::numeric_limits<double>::quiet_NaN())
+            , clicks_ac(algo_comm, configured_name + "_clicks", 0)
+            , adjustment_ac(algo_comm, configured_name + "_adjustment",
+                            std::numeric_limits<double>::quiet_NaN())
+        {
+            insert_member(output_channel);
+            patchbay.connect(&output_channel.writeaccess, this, &if_t::update);
+            insert_member(input_channel);
+            patchbay.connect(&input_channel.writeaccess, this, &if_t::update);
+            insert_member(level);
+            patchbay.connect(&level.writeaccess, this, &if_t::update);
+            insert_member(clicks);
+            patchbay.connect(&clicks.writeaccess, this, &if_t::update);
+            insert_member(interval);
+            patchbay.connect(&interval.writeaccess, this, &if_t::update);
+            insert_member(max_latency);
+            patchbay.connect(&max_latency.writeaccess, this, &if_t::update);
+            insert_member(min_quality);
+            patchbay.connect(&min_quality.writeaccess, this, &if_t::update);
+            insert_member(target);
+            patchbay.connect(&target.writeaccess, this, &if_t::update);
+            insert_member(input_share);
+            patchbay.connect(&input_share.writeaccess, this, &if_t::update);
+        }
+
+        /** Process callback, plays and detects the clicks.  The results of
+         * a calibration replace the previous ones from its first accepted
+         * click on, the adjustment only when the calibration is complete,
+         * so that the dll does not follow the average of the first clicks.
+         * @return pointer to the modified input signal */
+        mha_wave_t * process(mha_wave_t * s) {
+            T_TRACE_SCOPE("latency.process");
+            cfg_t * cfg = poll_config();
+            cfg->process(s);
+            clicks_ac.data = cfg->detected;
+            if (cfg->detected) {
+                latency_ac.data = cfg->latency();
+                spread_ac.data = cfg->spread();
+                if (cfg->complete())
+                    adjustment_ac.data = cfg->adjustment();
+            }
+            return s;
+        }
+        /** Prepare for signal processing.  Other signal dimensions may have
+         * another latency, previous results are discarded. */
+        void prepare(mhaconfig_t & /*signal_dimensions*/) {
+            latency_ac.data = spread_ac.data = adjustment_ac.data =
+                std::numeric_limits<double>::quiet_NaN();
+            clicks_ac.data = 0;
+            update();
+        }
+        /** Empty implementation of release. */
+        void release() {}
+
+        /** Connects configuration events to actions. */
+        MHAEvents::patchbay_t<if_t> patchbay;
+
+        /** Mean round trip latency in seconds, published as AC variable */
+        MHA_AC::double_t latency_ac;
+
+        /** Standard deviation of the single clicks in seconds, published
+         * as AC variable */
+        MHA_AC::double_t spread_ac;
+
+        /** Number of averaged clicks, published as AC variable */
+        MHA_AC::int_t clicks_ac;
+
+        /** Adjustment for plugin dll in seconds, published as AC variable */
+        MHA_AC::double_t adjustment_ac;
+
+        MHAParser::int_t output_channel =
+            {"Channel on which the clicks are played.  It is silent during\n"
+             "the calibration", "0", "[0,]"};
+
+        MHAParser::int_t input_channel =
+            {"Channel on which the clicks return through the loopback cable",
+             "0", "[0,]"};
+
+        MHAParser::float_t level =
+            {"Peak amplitude of the clicks", "0.5", "]0,1]"};
+
+        MHAParser::int_t clicks =
+            {"Number of clicks that are played and averaged", "20", "[1,]"};
+
+        MHAParser::float_t interval =
+            {"Time between two clicks in s", "0.5", "]0,]"};
+
+        MHAParser::float_t max_latency =
+            {"Largest round trip latency that is searched in s, less than\n"
+             "interval", "0.2", "]0,]"};
+
+        MHAParser::float_t min_quality =
+            {"Clicks with a lower normalized correlation with the played\n"
+             "click are not averaged", "0.5", "[0,1]"};
+
+        MHAParser::kw_t target =
+            {"Times that the adjustment makes the dll publish:\n"
+             "output: playback times of the output samples,\n"
+             "input: capture times of the input samples",
+             "output", "[output input]"};
+
+        MHAParser::float_t input_share =
+            {"Part of the round trip latency on the input side, 0.5 for\n"
+             "two periods and converters of equal latency", "0.5", "[0,1]"};
+
+        virtual void update(void) {
+            if (is_prepared())
+                push_config(new cfg_t(input_cfg(),
+                                      output_channel.data,
+                                      input_channel.data,
+                                      level.data,
+                                      clicks.data,
+                                      interval.data,
+                                      max_latency.data,
+                                      min_quality.data,
+                                      input_share.data,
+                                      target.data.get_value() == "output"));
+        }
+    };
+}
+
+MHAPLUGIN_CALLBACKS(latency,t::plugins::latency::if_t,wave,wave)
+
+MHAPLUGIN_DOCUMENTATION\
+(latency,
+ "acvariables time",
+ "Measures the round trip latency of the sound card through a loopback"
+ " cable.  Plays the click of plugin metronome on output_channel, detects"
+ " its return on input_channel with a matched filter, interpolates the"
+ " correlation peak with a parabola for sub-sample resolution and averages"
+ " the latency over the clicks.  Publishes <name>_latency, <name>_spread,"
+ " <name>_clicks and <name>_adjustment, the value for the adjustment of"
+ " plugin dll, which dll takes over when its adjustment_source is"
+ " <name>_adjustment."
+ )
+
+// Local variables:
+// compile-command: "make"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
@@ -0,0 +1,225 @@
+#include <mha_plugin.hh>
+#include <vector>
+
+namespace t::plugins::latency {
+
+    /** Runtime configuration class of MHA plugin which measures the round
+        trip latency through a loopback cable: clicks are played on one
+        output channel and detected in one input channel with a matched
+        filter.  One calibration run per configuration. */
+    class cfg_t {
+    public:
+        /** Constructor allocates all buffers.
+         * @param signal_dimensions fragsize, srate, channels
+         * @param output_channel channel on which the clicks are played
+         * @param input_channel channel on which the clicks return
+         * @param level peak amplitude of the clicks
+         * @param clicks number of clicks played and averaged
+         * @param interval time between two clicks in s
+         * @param max_latency largest round trip latency that is searched in s
+         * @param min_quality detections with a lower normalized correlation
+         *        are not averaged
+         * @param input_share part of the round trip latency attributed to
+         *        the input side, 0..1
+         * @param output_target true: the adjustment maps the filtered times
+         *        onto the playback of the output samples, false: onto the
+         *        capture of the input samples */
+        cfg_t(const mhaconfig_t & signal_dimensions,
+              unsigned output_channel,
+              unsigned input_channel,
+              float level,
+              unsigned clicks,
+              double interval,
+              double max_latency,
+              double min_quality,
+              double input_share,
+              bool output_target)
+            : output_channel(output_channel)
+            , input_channel(input_channel)
+            , srate(signal_dimensions.srate)
+            , clicks(clicks)
+            , interval(uint64_t(std::round(interval * srate)))
+            , min_quality(min_quality)
+            , input_share(input_share)
+            , output_target(output_target)
+            , click(metronome_click(signal_dimensions.srate, level))
+            , window(size_t(std::round(max_latency * srate)) + click.size())
+            , correlation(window.size() - click.size() + 1U)
+        {
+            for (float sample : click)
+                click_energy += double(sample) * sample;
+            const unsigned channel = std::max(output_channel, input_channel);
+            if (channel >= signal_dimensions.channels)
+                throw MHA_Error(__FILE__, __LINE__, "channel %u does not exist"
+                                " in signal with %u channels", channel,
+                                signal_dimensions.channels);
+            if (this->interval < window.size())
+                throw MHA_Error(__FILE__, __LINE__, "interval (%g s) must"
+                                " exceed max_latency (%g s) plus the click"
+                                " duration", interval, max_latency);
+        }
+        virtual ~cfg_t() = default;
+
+        const unsigned output_channel;
+        const unsigned input_channel;
+        const double srate;
+        const unsigned clicks;
+        /** Samples from one click to the next */
+        const uint64_t interval;
+        const double min_quality;
+        const double input_share;
+        const bool output_target;
+
+        /** Click waveform, the sound of plugin metronome */
+        const std::vector<float> click;
+        double click_energy = {0.0};
+
+        /** Input samples since the latest click, the click can return at
+         * any lag from 0 to max_latency */
+        std::vector<float> window;
+
+        /** Correlation of the click with the input at each lag */
+        std::vector<double> correlation;
+
+        /** Total sample index of the next sample */
+        uint64_t samples = {0U};
+
+        /** Total sample index of the latest click */
+        uint64_t emitted = {0U};
+
+        /** Clicks played so far */
+        unsigned played = {0U};
+
+        /** Whether the return of the latest click is being searched */
+        bool searching = {false};
+
+        /** Number, sum and sum of squares of the accepted round trip
+         * latencies in samples */
+        unsigned detected = {0U};
+        double sum = {0.0}, sum2 = {0.0};
+
+        /** Normalized correlation of the latest detection */
+        double quality = {0.0};
+
+        /** @return the plugin metronome's click, scaled to peak at level */
+        static std::vector<float> metronome_click(float srate, float level) {
+            const unsigned pre_samples = srate * 159.17e-6f;
+            std::vector<float> click(2U * pre_samples + 1U);
+            for (unsigned ds = 0; ds <= pre_samples; ++ds) {
+                float ds44 = ds * 44100 / srate;
+                click[pre_samples + ds] = click[pre_samples - ds] = level *
+                    (-0.01f * ds44 * ds44 - 0.02f * ds44 + 0.6330f) / 0.6330f;
+            }
+            return click;
+        }
+
+        /** Plays the clicks on the output channel and correlates the input
+         * channel with the click.  The output channel is silent between
+         * clicks and passes through unchanged after the calibration.
+         * No allocations, no locks. */
+        virtual void process(mha_wave_t * s) {
+            for (unsigned k = 0; k < s->num_frames; ++k, ++samples) {
+                if (played < clicks && samples == emitted + interval) {
+                    emitted = samples;
+                    searching = true;
+                    ++played;
+                }
+                if (searching)
+                    detect(value(s, k, input_channel));
+                if (played < clicks || searching) {
+                    const uint64_t age = samples - emitted;
+                    value(s, k, output_channel) = played && age < click.size()
+                        ? click[age] : 0.0f;
+                }
+            }
+        }
+
+        /** Appends one input sample to the window, computes the correlation
+         * at the lag that became complete and evaluates the window when
+         * all lags are complete. */
+        void detect(float input) {
+            const size_t age = samples - emitted;
+            window[age] = input;
+            if (age + 1U < click.size())
+                return;
+            const size_t lag = age + 1U - click.size();
+            double r = 0.0;
+            for (size_t i = 0; i < click.size(); ++i)
+                r += double(click[i]) * window[lag + i];
+            correlation[lag] = r;
+            if (lag + 1U == correlation.size()) {
+                searching = false;
+                evaluate();
+            }
+        }
+
+        /** Finds the correlation peak, interpolates it with a parabola for
+         * sub-sample resolution and accepts it if the normalized
+         * correlation reaches min_quality.  The polarity of the returned
+         * click does not matter. */
+        void evaluate() {
+            size_t peak = 0U;
+            for (size_t lag = 1U; lag < correlation.size(); ++lag)
+                if (std::fabs(correlation[lag]) > std::fabs(correlation[peak]))
+                    peak = lag;
+            const double sign = correlation[peak] < 0.0 ? -1.0 : 1.0;
+            double fraction = 0.0;
+            if (peak > 0U && peak + 1U < correlation.size()) {
+                const double left = sign * correlation[peak - 1U];
+                const double center = sign * correlation[peak];
+                const double right = sign * correlation[peak + 1U];
+                const double curvature = left - 2 * center + right;
+                if (curvature < 0.0)
+                    fraction = 0.5 * (left - right) / curvature;
+            }
+            double energy = 0.0;
+            for (size_t i = 0; i < click.size(); ++i)
+                energy += double(window[peak + i]) * window[peak + i];
+            quality = energy > 0.0 ?
+                sign * correlation[peak] / std::sqrt(click_energy * energy) :
+                0.0;
+            if (quality < min_quality)
+                return;
+            const double lag = peak + fraction;
+            ++detected;
+            sum += lag;
+            sum2 += lag * lag;
+        }
+
+        /** @return true when all clicks were played and searched */
+        bool complete() const {
+            return played == clicks && !searching;
+        }
+
+        /** @return mean round trip latency in s, NaN before the first
+         * detection */
+        double latency() const {
+            return detected ? sum / detected / srate :
+                std::numeric_limits<double>::quiet_NaN();
+        }
+
+        /** @return standard deviation of the single detections in s */
+        double spread() const {
+            if (detected < 2U)
+                return std::numeric_limits<double>::quiet_NaN();
+            const double mean = sum / detected;
+            return std::sqrt(std::max(0.0, sum2 / detected - mean * mean))
+                / srate;
+        }
+
+        /** @return the dll adjustment for the measured latency: the input
+         * samples were captured input_share * latency before, the output
+         * samples are played (1 - input_share) * latency after the times
+         * of the dll */
+        double adjustment() const {
+            return output_target ? (1.0 - input_share) * latency() :
+                -input_share * latency();
+        }
+    };
+}
+// Local variables:
+// compile-command: "make"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
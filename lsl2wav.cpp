@@ -1,36 +1,19 @@
 #include <memory>
 #include <mha_plugin.hh>
 #include <lsl_cpp.h>
+#include "ac_timebase.hh"
+#include "playout.hh"
 
 namespace t::plugins::lsl2wav {
 
-    /** Runtime configuration class of MHA plugin which receives an
-        LSL audio stream and resamples that stream to wav */
-    class cfg_t {
+    /** Receiving end of an LSL audio stream, used as the source of the
+        time-based playout. */
+    class source_t {
     public:
-        /** Constructor
+        /** Constructor resolves and opens the LSL stream.
          * @param d fragsize, srate, etc
-         * @param smoothed_time_base_name part of AC variable names where the
-         *        smoothed audio block start times are stored.  "_t0" and "_t1"
-         *        are appended to the base name to access the variables for
-         *        the filtered start times of the current (t0) and the next (t1)
-         *        buffer.
-         * @param name of the LSL stream to receive
-         */
-        cfg_t(const mhaconfig_t & d,
-              const std::string & smoothed_time_base_name,
-              const std::string & name,
-              algo_comm_t & ac)
-            : t0_name(smoothed_time_base_name+"_t0")
-            , t1_name(smoothed_time_base_name+"_t1")
-            , lsl_timestamps(d.fragsize, 0.0)
-            , lsl_samples(d.fragsize, d.channels)
-            , lsl_index(0)
-            , lsl_fill_count(0)
-            , silence(1, d.channels)
-            , ac(ac)
-            , t0(0.0)
-            , dt(1/double(d.srate))
+         * @param name of the LSL stream to receive */
+        source_t(const mhaconfig_t & d, const std::string & name)
         {
             auto lsl_infos = lsl::resolve_stream("name", name, 1, 5.0);
             // stream_infos index, identifying the stream that we want to open
@@ -51,85 +34,63 @@ namespace t::plugins::lsl2wav {
                 throw MHA_Error(__FILE__, __LINE__, "No LSL stream with name \""
                                 "%s\", type \"Audio\", srate %f and %u channels"
                                 " found", name.c_str(), d.srate, d.channels);
+            channels = d.channels;
+        }
+
+        std::unique_ptr<lsl::stream_inlet> lsl_inlet;
+        unsigned channels;
+
+        /** Pulls the next chunk from LSL without waiting.
+         * @return number of frames received */
+        size_t pull_chunk(float * samples, double * timestamps,
+                          size_t max_frames) {
+            if (lsl_inlet == nullptr)
+                return 0U;
+            return lsl_inlet->pull_chunk_multiplexed(samples, timestamps,
+                                                     max_frames * channels,
+                                                     max_frames, 0.0)
+                / channels;
+        }
+    };
+
+    /** Runtime configuration class of MHA plugin which receives an
+        LSL audio stream and resamples that stream to wav */
+    class cfg_t {
+    public:
+        /** Constructor
+         * @param d fragsize, srate, etc
+         * @param smoothed_time_base_name configured name of the dll plugin
+         *        which publishes the smoothed audio block start times, see
+         *        t::plugins::timebase::reader_t
+         * @param name of the LSL stream to receive
+         * @param concealment longest extrapolation of missing audio in s
+         */
+        cfg_t(const mhaconfig_t & d,
+              const std::string & smoothed_time_base_name,
+              const std::string & name,
+              double concealment,
+              algo_comm_t & ac)
+            : timebase(ac, smoothed_time_base_name, d.fragsize)
+            , playout(d, concealment, name)
+            , t0(0.0)
+            , dt(1/double(d.srate))
+        {
         }
 
         virtual ~cfg_t() = default;
 
-        const std::string t0_name, t1_name;
-        std::unique_ptr<lsl::stream_inlet> lsl_inlet;
-        std::vector<double> lsl_timestamps;
-        MHASignal::waveform_t lsl_samples;
-        size_t lsl_index, lsl_fill_count;
-        const MHASignal::waveform_t silence;
-        algo_comm_t & ac;
+        timebase::reader_t timebase;
+        playout::playout_t<source_t> playout;
         double t0;
         double dt;
         
-        /** Adds metronome beats to input/output signal. */
+        /** Replaces the signal with the received LSL audio. */
         virtual void process(mha_wave_t * s) {
             update_signal_times();
-            for (unsigned k = 0; k < s->num_frames; ++k) {
-                double t_sample = t0 + k * dt;
-                double t_next_sample = t0 + (k+1) * dt;
-                const float * lsl_sample =
-                    get_lsl_input_for(t_sample, t_next_sample);
-                for (unsigned ch = 0; ch < s->num_channels; ++ch)
-                    value(s, k, ch) = lsl_sample[ch];
-            }
-        }
-        const float * get_lsl_input_for(double t_sample, double t_next_sample) {
-            if (lsl_inlet == nullptr)
-                return silence.buf;
-
-            // simple nearest-neighbor lookup.
-            (void) t_next_sample;
-            
-            // Get chunk from LSL that matches the time of this sample
-            if (lsl_index >= lsl_fill_count ||
-                lsl_timestamps[lsl_fill_count-1] < t_sample) {
-                //printf("get_chunk(s) for sample %.17g\n", t_sample);
-                do {
-                    lsl_fill_count = lsl_inlet->
-                        pull_chunk_multiplexed(lsl_samples.buf,
-                                               &lsl_timestamps[0],
-                                               lsl_samples.get_size(),
-                                               lsl_timestamps.size(),
-                                               0.0)
-                        / lsl_samples.num_channels;
-                    lsl_index = 0;
-                    if (lsl_fill_count == 0)
-                        {}//printf("NO DATA\n");
-                    else
-                        {}//printf("RANGE:%.17g .. %.17g\n", lsl_timestamps[0],
-                          //      lsl_timestamps[lsl_fill_count-1]);
-                } while (lsl_fill_count != 0 //No more tries if there is no data
-                         && // If there is data, but it is too old, repeat:
-                         lsl_timestamps[lsl_fill_count-1] < t_sample);
-            }
-            if (lsl_index >= lsl_fill_count) // No data, return silence
-                return silence.buf;
-            for(; lsl_index < lsl_fill_count; ++lsl_index) {
-                //printf("ds=%f\n",lsl_timestamps[lsl_index] - t_sample);
-                if (lsl_timestamps[lsl_index] < t_sample)
-                    // This timestamp is too early, advance to later timestamps
-                    continue;
-                return &lsl_samples.value(lsl_index, 0);
-            }
-            // Execution should never reach this point
-            return nullptr;
+            playout.process(s, t0, dt);
         }
         void update_signal_times() {
-            t0 = get_ac(t0_name);
-            dt = (get_ac(t1_name) - t0) / lsl_timestamps.size();
-        }
-        double get_ac(const std::string & name) {
-            if (ac.is_var(name) == false)
-                return std::numeric_limits<double>::quiet_NaN();
-            comm_var_t cv = ac.get_var(name);
-            if (cv.data_type != MHA_AC_DOUBLE || cv.num_entries != 1 ||
-                cv.data == nullptr)
-                return std::numeric_limits<double>::quiet_NaN();
-            return *static_cast<const double*>(cv.data);
+            timebase.next_block(t0, dt);
         }
     };
 
@@ -147,12 +108,15 @@ namespace t::plugins::lsl2wav {
             patchbay.connect(&dll_plugin_name.writeaccess, this, &if_t::update);
             insert_member(stream_name);
             patchbay.connect(&stream_name.writeaccess, this, &if_t::update);
+            insert_member(concealment);
+            patchbay.connect(&concealment.writeaccess, this, &if_t::update);
         }
 
         /** Process callback for processing time domain signal. Input signal
          * is replaced or modified. 
          * @return unmodified pointer to input signal */
         mha_wave_t * process(mha_wave_t * s) {
+            T_TRACE_SCOPE("lsl2wav.process");
             poll_config()->process(s);
             return s;
         }
@@ -172,11 +136,17 @@ namespace t::plugins::lsl2wav {
         MHAParser::string_t stream_name =
             {"Name of LSL stream to read","wav2lsl"};
 
+        MHAParser::float_t concealment =
+            {"Longest time in s for which missing audio is extrapolated from\n"
+             "the last received pitch period before it fades to silence.\n"
+             "0: silence", "0", "[0,1]"};
+
         virtual void update(void) {
             if (is_prepared())
                 push_config(new cfg_t(input_cfg(),
                                       dll_plugin_name.data,
                                       stream_name.data,
+                                      concealment.data,
                                       ac));
         }
     };
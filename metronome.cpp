@@ -1,5 +1,7 @@
 #include <memory>
 #include <mha_plugin.hh>
+#include "ac_timebase.hh"
+#include "trace.hh"
 namespace t::plugins::metronome {
 
     /** Runtime configuration class of MHA plugin which implements the
@@ -9,11 +11,9 @@ namespace t::plugins::metronome {
         /** Constructor
          * @param signal_dimensions fragsize, srate, etc
          * @param bpm desired beats per minute of the metronome
-         * @param smoothed_time_base_name part of AC variable names where the
-         *        smoothed audio block start times are stored.  "_t0" and "_t1"
-         *        are appended to the base name to access the variables for
-         *        the filtered start times of the current (t0) and the next (t1)
-         *        buffer.
+         * @param smoothed_time_base_name configured name of the dll plugin
+         *        which publishes the smoothed audio block start times, see
+         *        t::plugins::timebase::reader_t
          * @param replace when true, the input signal is completely replaced
          *        with the metronome signal, otherwise the metronome signal
          *        is added to the input signal. */
@@ -22,11 +22,9 @@ namespace t::plugins::metronome {
               const std::string & smoothed_time_base_name,
               bool replace,
               algo_comm_t & ac)
-            : t0_name(smoothed_time_base_name+"_t0")
-            , t1_name(smoothed_time_base_name+"_t1")
+            : timebase(ac, smoothed_time_base_name, signal_dimensions.fragsize)
             , beat_period(60/double(bpm))
             , replace(replace)
-            , ac(ac)
         {
             const unsigned metronome_pre_samples = signal_dimensions.srate *
                 159.17e-6f;
@@ -50,15 +48,16 @@ namespace t::plugins::metronome {
 
         std::unique_ptr<MHASignal::waveform_t> metronomesound;
         std::unique_ptr<MHASignal::waveform_t> future;
-        const std::string t0_name, t1_name;
+        timebase::reader_t timebase;
         const double beat_period;
         const bool replace;
-        algo_comm_t & ac;
         
         /** Adds metronome beats to input/output signal. */
         virtual void process(mha_wave_t * s) {
-            double t0 = get_ac(t0_name) / beat_period;
-            double t1 = get_ac(t1_name) / beat_period;
+            double t0, dt;
+            timebase.next_block(t0, dt);
+            double t1 = (t0 + dt * s->num_frames) / beat_period;
+            t0 /= beat_period;
             if (need_insert_new_activation(t0,t1)) {
                 for (double beat = ceil(t0); beat <= floor(t1) + 0.5; ++beat)
                     insert_new_activation_at((beat - t0) * s->num_frames
@@ -66,15 +65,6 @@ namespace t::plugins::metronome {
             }
             playback_and_update(s);
         }
-        double get_ac(const std::string & name) {
-            if (ac.is_var(name) == false)
-                return std::numeric_limits<double>::quiet_NaN();
-            comm_var_t cv = ac.get_var(name);
-            if (cv.data_type != MHA_AC_DOUBLE || cv.num_entries != 1 ||
-                cv.data == nullptr)
-                return std::numeric_limits<double>::quiet_NaN();
-            return *static_cast<const double*>(cv.data);
-        }
         bool need_insert_new_activation(double t0, double t1) {
             return (!std::isnan(t0)) && (!std::isnan(t1)) &&
                 (!std::isinf(t0)) && (!std::isinf(t1)) &&
@@ -126,6 +116,7 @@ namespace t::plugins::metronome {
          * is replaced or modified. 
          * @return unmodified pointer to input signal */
         mha_wave_t * process(mha_wave_t * s) {
+            T_TRACE_SCOPE("metronome.process");
             poll_config()->process(s);
             return s;
         }
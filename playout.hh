@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <mha_plugin.hh>
+#include "trace.hh"
+
+namespace t::plugins::playout {
+
+    /** Packet-loss concealment: fills gaps in the received audio with a
+     * periodic extrapolation of the last received pitch period, found by
+     * waveform matching, and cross-fades back to the received audio when
+     * it resumes.  The extrapolation keeps full level for half of the
+     * maximum duration, then fades out.  Never allocates after
+     * construction. */
+    class concealer_t {
+    public:
+        /** Constructor
+         * @param channels number of audio channels
+         * @param srate sampling rate / Hz
+         * @param max_duration longest extrapolation / s, 0: silence */
+        concealer_t(unsigned channels, double srate, double max_duration)
+            : channels(channels)
+            , min_period(std::max(2U, unsigned(srate / 400)))
+            , max_period(std::max(min_period, unsigned(srate / 50)))
+            , window(std::max(2U, unsigned(srate / 200)))
+            , fade(std::max(1U, unsigned(srate / 400)))
+            , max_frames(unsigned(max_duration * srate))
+            , length(max_period + window + 1U)
+            , history(2 * size_t(length) * channels, 0.0f)
+            , loudest(length, 0.0f)
+            , frame(channels, 0.0f)
+            , zero(channels, 0.0f)
+        {}
+
+        const unsigned channels;
+        /** Shortest and longest pitch period searched, 2.5 ms and 20 ms,
+         * in frames */
+        const unsigned min_period, max_period;
+        /** Frames matched by the period search (5 ms) and of the
+         * cross-fade back to the received audio (2.5 ms) */
+        const unsigned window, fade;
+        /** Longest extrapolation in frames */
+        const unsigned max_frames;
+        /** Frames of history */
+        const unsigned length;
+        /** Last length frames, multiplexed, stored twice so that they are
+         * contiguous from position on */
+        std::vector<float> history;
+        /** History of the loudest channel, for the period search */
+        std::vector<float> loudest;
+        /** Output frame and a silent frame */
+        std::vector<float> frame, zero;
+        /** Index of the oldest frame of history */
+        unsigned position = {0U};
+        /** Number of valid frames in history */
+        unsigned filled = {0U};
+        /** Whether the latest frame was missing */
+        bool gap = {false};
+        /** Missing frames in the current gap, at most max_frames */
+        unsigned gap_frames = {0U};
+        /** Pitch period of the extrapolation, 0: no history to extrapolate */
+        unsigned period = {0U};
+        /** Remaining frames of the cross-fade back to received audio */
+        unsigned fading = {0U};
+        /** Gain of the extrapolation at the end of the gap */
+        float gain = {0.0f};
+
+        /** Passes a received frame, cross-faded from the extrapolation
+         * after a gap.
+         * @return pointer to channels sample values */
+        const float * received(const float * x) {
+            if (gap) {
+                gap = false;
+                fading = fade;
+            }
+            if (fading == 0U) {
+                push(x);
+                return x;
+            }
+            const float * e = extrapolation();
+            const float w = float(fade - fading + 1U) / (fade + 1U);
+            for (unsigned ch = 0; ch < channels; ++ch)
+                frame[ch] = w * x[ch] + (1.0f - w) * gain * e[ch];
+            --fading;
+            push(x);
+            return frame.data();
+        }
+
+        /** Conceals a missing frame.
+         * @return pointer to channels sample values, nullptr when the
+         *         frame is silent */
+        const float * missing() {
+            if (!gap) {
+                gap = true;
+                gap_frames = 0U;
+                fading = 0U;
+                period = find_period();
+            }
+            gain = gap_gain(gap_frames);
+            // Saturates: after 2^32 frames, a day at 48 kHz, the count
+            // would wrap around and the extrapolation restart at full level
+            if (gap_frames < max_frames)
+                ++gap_frames;
+            const float * e = extrapolation();
+            for (unsigned ch = 0; ch < channels; ++ch)
+                frame[ch] = gain * e[ch];
+            push(e); // unattenuated, the next period repeats it
+            return gain > 0.0f ? frame.data() : nullptr;
+        }
+
+        /** @return one period before the next frame, silence without
+         * period */
+        const float * extrapolation() const {
+            if (period == 0U)
+                return zero.data();
+            return &history[size_t(position + length - period) * channels];
+        }
+
+        /** @return gain of the k-th missing frame of a gap */
+        float gap_gain(unsigned k) const {
+            if (period == 0U || k >= max_frames)
+                return 0.0f;
+            const unsigned hold = max_frames / 2U;
+            return k < hold ? 1.0f : float(max_frames - k) / (max_frames - hold);
+        }
+
+        /** Appends a frame to the history */
+        void push(const float * x) {
+            float * first = &history[size_t(position) * channels];
+            float * second = &history[size_t(position + length) * channels];
+            for (unsigned ch = 0; ch < channels; ++ch)
+                first[ch] = second[ch] = x[ch];
+            position = (position + 1U) % length;
+            filled = std::min(filled + 1U, length);
+        }
+
+        /** Finds the lag with the highest normalized correlation between
+         * the latest window of the loudest channel and the window one lag
+         * earlier.  Searches every second lag on every second frame, then
+         * refines around the best lag.
+         * @return the pitch period, 0 if the history is too short */
+        unsigned find_period() {
+            if (filled < length)
+                return 0U;
+            const float * oldest = &history[size_t(position) * channels];
+            unsigned channel = 0U;
+            float max_energy = -1.0f;
+            for (unsigned ch = 0; ch < channels; ++ch) {
+                float energy = 0.0f;
+                for (unsigned k = length - window; k < length; ++k)
+                    energy += oldest[k * channels + ch] *
+                        oldest[k * channels + ch];
+                if (energy > max_energy) {
+                    max_energy = energy;
+                    channel = ch;
+                }
+            }
+            for (unsigned k = 0; k < length; ++k)
+                loudest[k] = oldest[size_t(k) * channels + channel];
+            const float * target = &loudest[length - window];
+            unsigned best = max_period;
+            float best_score = 0.0f;
+            auto score = [&](unsigned lag, unsigned step) {
+                const float * candidate = target - lag;
+                float c = 0.0f, e = 0.0f;
+                for (unsigned i = 0; i < window; i += step) {
+                    c += target[i] * candidate[i];
+                    e += candidate[i] * candidate[i];
+                }
+                return (c > 0.0f && e > 0.0f) ? c * c / e : 0.0f;
+            };
+            for (unsigned lag = min_period; lag <= max_period; lag += 2U) {
+                const float s = score(lag, 2U);
+                if (s > best_score) {
+                    best_score = s;
+                    best = lag;
+                }
+            }
+            const unsigned coarse = best;
+            best_score = 0.0f;
+            for (unsigned lag = std::max(min_period, coarse - 1U);
+                 lag <= std::min(max_period, coarse + 1U); ++lag) {
+                const float s = score(lag, 1U);
+                if (s > best_score) {
+                    best_score = s;
+                    best = lag;
+                }
+            }
+            return best;
+        }
+    };
+
+    /** Time-based playout of a stream of timestamped audio frames.
+     * For every output sample, the received frame with the matching time
+     * stamp is looked up (simple nearest-neighbor lookup).  When no
+     * matching frame has been received, the concealer extrapolates the
+     * received audio, silence follows when it gives up.
+     * @tparam source_t Receiving end of the transport.  Must provide
+     *         size_t pull_chunk(float * samples, double * timestamps,
+     *                           size_t max_frames)
+     *         which copies at most max_frames multiplexed frames and their
+     *         time stamps without blocking and returns the number of
+     *         frames copied. */
+    template<class source_t>
+    class playout_t {
+    public:
+        /** Constructor
+         * @param d fragsize, channels, srate
+         * @param concealment longest extrapolation of missing frames / s
+         * @param args Forwarded to the constructor of source_t */
+        template<class... args_t>
+        playout_t(const mhaconfig_t & d, double concealment,
+                  args_t && ... args)
+            : source(d, std::forward<args_t>(args)...)
+            , timestamps(d.fragsize, 0.0)
+            , samples(d.fragsize, d.channels)
+            , index(0)
+            , fill_count(0)
+            , silence(1, d.channels)
+            , concealer(d.channels, d.srate, concealment)
+        {}
+
+        source_t source;
+        std::vector<double> timestamps;
+        MHASignal::waveform_t samples;
+        size_t index, fill_count;
+        const MHASignal::waveform_t silence;
+        concealer_t concealer;
+        /** Frames pulled from the source, concealed and silent output
+         * frames in the current block, for tracing */
+        size_t pulled = {0U}, concealed = {0U}, silent = {0U};
+
+        /** Look up the received frame for the given sample time.
+         * @return pointer to num_channels sample values, nullptr if no
+         *         frame has been received for this time */
+        const float * get_input_for(double t_sample, double t_next_sample) {
+            // simple nearest-neighbor lookup.
+            (void) t_next_sample;
+
+            // Get chunk from source that matches the time of this sample
+            if (index >= fill_count ||
+                timestamps[fill_count-1] < t_sample) {
+                do {
+                    fill_count = source.pull_chunk(samples.buf,
+                                                   &timestamps[0],
+                                                   timestamps.size());
+                    pulled += fill_count;
+                    index = 0;
+                } while (fill_count != 0 //No more tries if there is no data
+                         && // If there is data, but it is too old, repeat:
+                         timestamps[fill_count-1] < t_sample);
+            }
+            if (index >= fill_count) // No data
+                return nullptr;
+            for(; index < fill_count; ++index) {
+                if (timestamps[index] < t_sample)
+                    // This timestamp is too early, advance to later timestamps
+                    continue;
+                return &samples.value(index, 0);
+            }
+            // Execution should never reach this point
+            return nullptr;
+        }
+
+        /** Replace the signal with the received frames.
+         * @param s signal to replace
+         * @param t0 time of the first sample of s
+         * @param dt time between two samples */
+        void process(mha_wave_t * s, double t0, double dt) {
+            pulled = concealed = silent = 0U;
+            for (unsigned k = 0; k < s->num_frames; ++k) {
+                double t_sample = t0 + k * dt;
+                double t_next_sample = t0 + (k+1) * dt;
+                const float * sample = get_input_for(t_sample, t_next_sample);
+                if (sample) {
+                    sample = concealer.received(sample);
+                } else if ((sample = concealer.missing())) {
+                    ++concealed;
+                } else {
+                    ++silent;
+                    sample = silence.buf;
+                }
+                for (unsigned ch = 0; ch < s->num_channels; ++ch)
+                    value(s, k, ch) = sample[ch];
+            }
+            T_TRACE_VALUE("playout.pulled", pulled);
+            T_TRACE_VALUE("playout.concealed", concealed);
+            T_TRACE_VALUE("playout.silent", silent);
+        }
+    };
+}
+// Local variables:
+// compile-command: "make"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
@@ -0,0 +1,236 @@
+// Interposes memory allocation, locking and blocking system call
+// functions of the C library for the real-time safety checks of the unit
+// tests.  The interposed functions count their calls while a
+// t::rt_safety::guard_t is active on the calling thread and then forward
+// to the C library.  Link this file into an executable, not into a plugin.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "rt_safety.hh"
+#include <atomic>
+#include <cerrno>
+#include <cstdarg>
+#include <cstddef>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/epoll.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C" {
+    // glibc's own allocator entry points, see "Replacing malloc" in the
+    // glibc manual.
+    void * __libc_malloc(size_t);
+    void * __libc_calloc(size_t, size_t);
+    void * __libc_realloc(void *, size_t);
+    void * __libc_memalign(size_t, size_t);
+    void __libc_free(void *);
+}
+
+namespace {
+    /** Counter of the guard active on this thread, or nullptr */
+    thread_local t::rt_safety::violations_t * active = nullptr;
+
+    enum kind_t {ALLOCATION, DEALLOCATION, LOCK, SYSCALL};
+
+    inline void note(kind_t kind, const char * function) {
+        t::rt_safety::violations_t * v = active;
+        if (v == nullptr)
+            return;
+        switch (kind) {
+        case ALLOCATION: ++v->allocations; break;
+        case DEALLOCATION: ++v->deallocations; break;
+        case LOCK: ++v->locks; break;
+        case SYSCALL: ++v->syscalls; break;
+        }
+        if (v->first == nullptr)
+            v->first = function;
+    }
+
+    /** Looks up the next definition of an interposed function. Versioned
+     * lookup first because dlsym may return an outdated symbol version of
+     * e.g. pthread_cond_wait. */
+    template<class fn_t>
+    fn_t next(std::atomic<fn_t> & fn, const char * name,
+              const char * version = nullptr) {
+        fn_t f = fn.load(std::memory_order_relaxed);
+        if (f == nullptr) {
+            void * sym = version ? dlvsym(RTLD_NEXT, name, version) : nullptr;
+            if (sym == nullptr)
+                sym = dlsym(RTLD_NEXT, name);
+            f = reinterpret_cast<fn_t>(sym);
+            fn.store(f, std::memory_order_relaxed);
+        }
+        return f;
+    }
+}
+
+t::rt_safety::guard_t::guard_t()
+{
+    active = &counts;
+}
+
+t::rt_safety::guard_t::~guard_t()
+{
+    active = nullptr;
+}
+
+// Forwards a function with fixed parameter list after counting the call.
+#define RT_SAFETY_FORWARD(kind, ret, name, params, args, ...)           \
+    extern "C" ret name params {                                        \
+        static std::atomic<ret (*) params> real = {nullptr};            \
+        note(kind, #name);                                              \
+        return next(real, #name, ##__VA_ARGS__) args;                   \
+    }
+
+extern "C" {
+    void * malloc(size_t size) {
+        note(ALLOCATION, "malloc");
+        return __libc_malloc(size);
+    }
+    void * calloc(size_t count, size_t size) {
+        note(ALLOCATION, "calloc");
+        return __libc_calloc(count, size);
+    }
+    void * realloc(void * ptr, size_t size) {
+        note(ALLOCATION, "realloc");
+        return __libc_realloc(ptr, size);
+    }
+    void * memalign(size_t alignment, size_t size) {
+        note(ALLOCATION, "memalign");
+        return __libc_memalign(alignment, size);
+    }
+    void * aligned_alloc(size_t alignment, size_t size) {
+        note(ALLOCATION, "aligned_alloc");
+        return __libc_memalign(alignment, size);
+    }
+    void * valloc(size_t size) {
+        note(ALLOCATION, "valloc");
+        return __libc_memalign(sysconf(_SC_PAGESIZE), size);
+    }
+    int posix_memalign(void ** ptr, size_t alignment, size_t size) {
+        note(ALLOCATION, "posix_memalign");
+        if (alignment % sizeof(void*) != 0U ||
+            (alignment & (alignment - 1U)) != 0U)
+            return EINVAL;
+        void * p = __libc_memalign(alignment, size);
+        if (p == nullptr)
+            return ENOMEM;
+        *ptr = p;
+        return 0;
+    }
+    void free(void * ptr) {
+        if (ptr != nullptr)
+            note(DEALLOCATION, "free");
+        __libc_free(ptr);
+    }
+
+    int open(const char * path, int flags, ...) {
+        static std::atomic<int (*)(const char*, int, ...)> real = {nullptr};
+        note(SYSCALL, "open");
+        mode_t mode = 0;
+        if (flags & (O_CREAT | O_TMPFILE)) {
+            va_list ap;
+            va_start(ap, flags);
+            mode = va_arg(ap, mode_t);
+            va_end(ap);
+        }
+        return next(real, "open")(path, flags, mode);
+    }
+    int openat(int dirfd, const char * path, int flags, ...) {
+        static std::atomic<int (*)(int, const char*, int, ...)> real =
+            {nullptr};
+        note(SYSCALL, "openat");
+        mode_t mode = 0;
+        if (flags & (O_CREAT | O_TMPFILE)) {
+            va_list ap;
+            va_start(ap, flags);
+            mode = va_arg(ap, mode_t);
+            va_end(ap);
+        }
+        return next(real, "openat")(dirfd, path, flags, mode);
+    }
+    long syscall(long number, ...) {
+        static std::atomic<long (*)(long, ...)> real = {nullptr};
+        note(SYSCALL, "syscall");
+        va_list ap;
+        va_start(ap, number);
+        long a[6];
+        for (long & arg : a)
+            arg = va_arg(ap, long);
+        va_end(ap);
+        return next(real, "syscall")(number, a[0], a[1], a[2], a[3], a[4],
+                                     a[5]);
+    }
+}
+
+RT_SAFETY_FORWARD(LOCK, int, pthread_mutex_lock, (pthread_mutex_t * m), (m))
+RT_SAFETY_FORWARD(LOCK, int, pthread_mutex_timedlock,
+                  (pthread_mutex_t * m, const struct timespec * t), (m, t))
+RT_SAFETY_FORWARD(LOCK, int, pthread_rwlock_rdlock, (pthread_rwlock_t * l),
+                  (l))
+RT_SAFETY_FORWARD(LOCK, int, pthread_rwlock_wrlock, (pthread_rwlock_t * l),
+                  (l))
+RT_SAFETY_FORWARD(LOCK, int, pthread_cond_wait,
+                  (pthread_cond_t * c, pthread_mutex_t * m), (c, m),
+                  "GLIBC_2.3.2")
+RT_SAFETY_FORWARD(LOCK, int, pthread_cond_timedwait,
+                  (pthread_cond_t * c, pthread_mutex_t * m,
+                   const struct timespec * t), (c, m, t), "GLIBC_2.3.2")
+RT_SAFETY_FORWARD(LOCK, int, sem_wait, (sem_t * s), (s))
+RT_SAFETY_FORWARD(LOCK, int, sem_timedwait,
+                  (sem_t * s, const struct timespec * t), (s, t))
+
+RT_SAFETY_FORWARD(SYSCALL, ssize_t, read, (int fd, void * buf, size_t n),
+                  (fd, buf, n))
+RT_SAFETY_FORWARD(SYSCALL, ssize_t, write,
+                  (int fd, const void * buf, size_t n), (fd, buf, n))
+RT_SAFETY_FORWARD(SYSCALL, int, close, (int fd), (fd))
+RT_SAFETY_FORWARD(SYSCALL, int, fsync, (int fd), (fd))
+RT_SAFETY_FORWARD(SYSCALL, int, nanosleep,
+                  (const struct timespec * t, struct timespec * r), (t, r))
+RT_SAFETY_FORWARD(SYSCALL, int, clock_nanosleep,
+                  (clockid_t c, int f, const struct timespec * t,
+                   struct timespec * r), (c, f, t, r))
+RT_SAFETY_FORWARD(SYSCALL, int, usleep, (useconds_t u), (u))
+RT_SAFETY_FORWARD(SYSCALL, int, sched_yield, (void), ())
+RT_SAFETY_FORWARD(SYSCALL, int, poll, (struct pollfd * p, nfds_t n, int t),
+                  (p, n, t))
+RT_SAFETY_FORWARD(SYSCALL, int, select,
+                  (int n, fd_set * r, fd_set * w, fd_set * e,
+                   struct timeval * t), (n, r, w, e, t))
+RT_SAFETY_FORWARD(SYSCALL, int, epoll_wait,
+                  (int e, struct epoll_event * v, int n, int t), (e, v, n, t))
+RT_SAFETY_FORWARD(SYSCALL, int, connect,
+                  (int s, const struct sockaddr * a, socklen_t l), (s, a, l))
+RT_SAFETY_FORWARD(SYSCALL, int, accept,
+                  (int s, struct sockaddr * a, socklen_t * l), (s, a, l))
+RT_SAFETY_FORWARD(SYSCALL, ssize_t, send,
+                  (int s, const void * b, size_t n, int f), (s, b, n, f))
+RT_SAFETY_FORWARD(SYSCALL, ssize_t, sendto,
+                  (int s, const void * b, size_t n, int f,
+                   const struct sockaddr * a, socklen_t l),
+                  (s, b, n, f, a, l))
+RT_SAFETY_FORWARD(SYSCALL, ssize_t, sendmsg,
+                  (int s, const struct msghdr * m, int f), (s, m, f))
+RT_SAFETY_FORWARD(SYSCALL, ssize_t, recv, (int s, void * b, size_t n, int f),
+                  (s, b, n, f))
+RT_SAFETY_FORWARD(SYSCALL, ssize_t, recvfrom,
+                  (int s, void * b, size_t n, int f, struct sockaddr * a,
+                   socklen_t * l), (s, b, n, f, a, l))
+RT_SAFETY_FORWARD(SYSCALL, ssize_t, recvmsg,
+                  (int s, struct msghdr * m, int f), (s, m, f))
+
+// Local variables:
+// compile-command: "make unit-tests"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
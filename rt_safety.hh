@@ -0,0 +1,57 @@
+#include <ostream>
+
+namespace t::rt_safety {
+
+    /** Real-time unsafe calls made by one thread while a guard_t was
+     * active on that thread. */
+    struct violations_t {
+        /** calls to malloc, calloc, realloc, memalign and relatives,
+         * including those made by operator new */
+        unsigned allocations = {0U};
+        /** calls to free, including those made by operator delete */
+        unsigned deallocations = {0U};
+        /** calls to pthread mutex, rwlock, condition variable and
+         * semaphore wait functions that may block */
+        unsigned locks = {0U};
+        /** calls to system call wrappers that may block or enter the
+         * kernel: I/O, sleeping, polling, syscall() */
+        unsigned syscalls = {0U};
+        /** name of the first unsafe function called, or nullptr */
+        const char * first = {nullptr};
+
+        /** @return total number of unsafe calls */
+        unsigned total() const {
+            return allocations + deallocations + locks + syscalls;
+        }
+    };
+
+    /** While an object of this class exists, calls of the constructing
+     * thread to the interposed allocation, locking and system call
+     * functions are counted.  Link rt_safety.o into the test executable to
+     * interpose these functions.  Guards must not be nested. */
+    class guard_t {
+    public:
+        guard_t();
+        ~guard_t();
+        guard_t(const guard_t &) = delete;
+        guard_t & operator=(const guard_t &) = delete;
+        /** @return the unsafe calls counted so far */
+        const violations_t & violations() const {return counts;}
+    private:
+        violations_t counts;
+    };
+
+    inline std::ostream & operator<<(std::ostream & o, const violations_t & v)
+    {
+        return o << v.allocations << " allocations, " << v.deallocations
+                 << " deallocations, " << v.locks << " locks, " << v.syscalls
+                 << " system calls, first: "
+                 << (v.first ? v.first : "none");
+    }
+}
+// Local variables:
+// compile-command: "make unit-tests"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
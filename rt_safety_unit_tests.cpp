@@ -0,0 +1,222 @@
+#include "rt_safety.hh"
+#include <gmock/gmock.h>
+#include <gtest/gtest-spi.h>
+#include <mha_algo_comm.hh>
+#include <mha_signal.hh>
+#include <mhapluginloader.h>
+#include <memory>
+#include <mutex>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using t::rt_safety::guard_t;
+
+TEST(rt_safety, clean_code_has_no_violations) {
+    guard_t guard;
+    volatile double x = 1.0;
+    x = x * 2.0;
+    struct timespec ts; // clock_gettime is served by the vDSO
+    clock_gettime(CLOCK_REALTIME, &ts);
+    EXPECT_EQ(0U, guard.violations().total()) << guard.violations();
+}
+
+TEST(rt_safety, detects_allocation) {
+    guard_t guard;
+    void * volatile p = malloc(16);
+    free(p);
+    EXPECT_EQ(1U, guard.violations().allocations);
+    EXPECT_EQ(1U, guard.violations().deallocations);
+    EXPECT_STREQ("malloc", guard.violations().first);
+}
+
+TEST(rt_safety, detects_operator_new) {
+    guard_t guard;
+    std::unique_ptr<std::string> s =
+        std::make_unique<std::string>(100U, 'x');
+    volatile char c = (*s)[50];
+    (void) c;
+    EXPECT_LE(1U, guard.violations().allocations);
+}
+
+TEST(rt_safety, detects_lock) {
+    std::mutex mutex;
+    guard_t guard;
+    mutex.lock();
+    mutex.unlock();
+    EXPECT_EQ(1U, guard.violations().locks);
+    EXPECT_STREQ("pthread_mutex_lock", guard.violations().first);
+}
+
+TEST(rt_safety, detects_syscall) {
+    guard_t guard;
+    usleep(1);
+    EXPECT_EQ(1U, guard.violations().syscalls);
+}
+
+TEST(rt_safety, counts_only_while_guarded) {
+    {
+        guard_t guard;
+    }
+    void * volatile p = malloc(16);
+    free(p);
+    guard_t guard;
+    EXPECT_EQ(0U, guard.violations().total());
+}
+
+/** Loads plugins into one AC space like openMHA does and checks that the
+ * process callback of the last plugin is real-time safe.  The plugins are
+ * loaded from MHA_LIBRARY_PATH, "make unit-tests" sets it to this
+ * directory. */
+class rt_safety_fixture : public ::testing::Test {
+public:
+    MHAKernel::algo_comm_class_t algo_comm;
+    std::vector<std::unique_ptr<PluginLoader::mhapluginloader_t>> plugins;
+    mhaconfig_t signal_dimensions =
+        {.channels=2, .domain=MHA_WAVEFORM, .fragsize=96, .wndlen=400,
+         .fftlen=800, .srate=44100};
+    MHASignal::waveform_t signal = {96U, 2U};
+
+    void load(const std::string & name,
+              const std::vector<std::string> & commands = {}) {
+        plugins.push_back(std::make_unique<PluginLoader::mhapluginloader_t>
+                          (algo_comm.get_c_handle(), name));
+        for (const std::string & command : commands)
+            plugins.back()->parse(command);
+        mhaconfig_t cf = signal_dimensions;
+        plugins.back()->prepare(cf);
+    }
+
+    /** Process blocks with all plugins, count unsafe calls of the last.
+     * @return the unsafe calls made by the last plugin in all blocks */
+    t::rt_safety::violations_t process_last(unsigned blocks = 100U) {
+        t::rt_safety::violations_t total;
+        for (unsigned block = 0; block < blocks; ++block) {
+            mha_wave_t * s = &signal;
+            for (size_t index = 0; index + 1 < plugins.size(); ++index)
+                plugins[index]->process(s, &s);
+            guard_t guard;
+            plugins.back()->process(s, &s);
+            const t::rt_safety::violations_t & v = guard.violations();
+            total.allocations += v.allocations;
+            total.deallocations += v.deallocations;
+            total.locks += v.locks;
+            total.syscalls += v.syscalls;
+            if (total.first == nullptr)
+                total.first = v.first;
+        }
+        return total;
+    }
+
+    void TearDown() override {
+        for (auto plugin = plugins.rbegin(); plugin != plugins.rend();
+             ++plugin)
+            (*plugin)->release();
+    }
+};
+
+TEST_F(rt_safety_fixture, dll) {
+    load("dll");
+    auto v = process_last();
+    EXPECT_EQ(0U, v.total()) << v;
+}
+
+TEST_F(rt_safety_fixture, dll_auto_bandwidth) {
+    // short tuning time: the rls window is resized within the test
+    load("dll", {"estimator=rls", "auto_bandwidth=yes", "tuning_time=0.01"});
+    auto v = process_last();
+    EXPECT_EQ(0U, v.total()) << v;
+}
+
+TEST_F(rt_safety_fixture, timestamper) {
+    load("timestamper");
+    auto v = process_last();
+    EXPECT_EQ(0U, v.total()) << v;
+}
+
+TEST_F(rt_safety_fixture, metronome) {
+    load("dll");
+    load("metronome", {"bpm=600"});
+    auto v = process_last();
+    EXPECT_EQ(0U, v.total()) << v;
+}
+
+TEST_F(rt_safety_fixture, drift) {
+    load("dll");
+    load("drift", {"dll_b=dll"});
+    auto v = process_last();
+    EXPECT_EQ(0U, v.total()) << v;
+}
+
+TEST_F(rt_safety_fixture, syncmeter) {
+    load("syncmeter", {"window=0.1", "interval=0.01"});
+    auto v = process_last();
+    EXPECT_EQ(0U, v.total()) << v;
+}
+
+TEST_F(rt_safety_fixture, latency) {
+    // clicks every 50 ms: several clicks are played and detected
+    load("latency", {"input_channel=1", "interval=0.05", "max_latency=0.04"});
+    auto v = process_last();
+    EXPECT_EQ(0U, v.total()) << v;
+}
+
+TEST_F(rt_safety_fixture, dll_adjustment_source) {
+    load("latency");
+    load("dll", {"adjustment_source=latency_adjustment"});
+    auto v = process_last();
+    EXPECT_EQ(0U, v.total()) << v;
+}
+
+TEST_F(rt_safety_fixture, dll_timebase) {
+    shm_unlink("/rt_safety_dll_timebase");
+    load("dll", {"timebase_name=/rt_safety_dll_timebase"});
+    auto v = process_last();
+    EXPECT_EQ(0U, v.total()) << v;
+    shm_unlink("/rt_safety_dll_timebase");
+}
+
+TEST_F(rt_safety_fixture, wav2shm) {
+    shm_unlink("/rt_safety_wav2shm");
+    load("dll");
+    load("wav2shm", {"shm_name=/rt_safety_wav2shm"});
+    auto v = process_last();
+    EXPECT_EQ(0U, v.total()) << v;
+    shm_unlink("/rt_safety_wav2shm");
+}
+
+TEST_F(rt_safety_fixture, shm2wav) {
+    shm_unlink("/rt_safety_shm2wav");
+    load("dll");
+    load("wav2shm", {"shm_name=/rt_safety_shm2wav"});
+    load("shm2wav", {"shm_name=/rt_safety_shm2wav", "concealment=0.04"});
+    auto v = process_last();
+    EXPECT_EQ(0U, v.total()) << v;
+    shm_unlink("/rt_safety_shm2wav");
+}
+
+// liblsl is not real-time safe: the outlet locks its list of consumers
+// for every pushed sample, the inlet starts its data thread on the first
+// pull and waits on locks of its sample queue.  These tests pin that the
+// violations are there; when they fail, liblsl or the plugins have become
+// real-time safe and the expectation can change to 0.
+TEST_F(rt_safety_fixture, wav2lsl) {
+    load("dll");
+    load("wav2lsl", {"stream_name=rt_safety_wav2lsl"});
+    auto v = process_last();
+    EXPECT_NONFATAL_FAILURE(EXPECT_EQ(0U, v.total()) << v, "v.total()");
+}
+
+TEST_F(rt_safety_fixture, lsl2wav) {
+    load("dll");
+    load("wav2lsl", {"stream_name=rt_safety_lsl2wav"});
+    load("lsl2wav", {"stream_name=rt_safety_lsl2wav"});
+    auto v = process_last();
+    EXPECT_NONFATAL_FAILURE(EXPECT_EQ(0U, v.total()) << v, "v.total()");
+}
+
+// Local variables:
+// compile-command: "make unit-tests"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
@@ -0,0 +1,199 @@
+#include <memory>
+#include <mha_plugin.hh>
+#include "ac_timebase.hh"
+#include "shm_ring.hh"
+#include "playout.hh"
+
+namespace t::plugins::shm2wav {
+
+    /** Reading end of the shared memory ring, used as the source of the
+        time-based playout. */
+    class source_t {
+    public:
+        /** Constructor opens the shared memory ring.
+         * @param d fragsize, srate, etc
+         * @param name of the shared memory segment to read */
+        source_t(const mhaconfig_t & d, const std::string & name)
+            : d(d)
+            , name(name)
+            , ring(open_ring(d, name))
+            , read_index(ring->write_index())
+        {
+        }
+
+        /** Signal dimensions that the ring must match */
+        const mhaconfig_t d;
+        const std::string name;
+        std::unique_ptr<shm::ring_t> ring;
+        uint64_t read_index;
+        /** Calls of pull_chunk until the next attempt to open the ring
+         * again after a failed one */
+        unsigned reopen_countdown = {0U};
+        static constexpr unsigned reopen_interval = 100U;
+
+        /** Opens the ring and checks that it matches the signal.
+         * @throw MHA_Error if it cannot be opened or does not match */
+        static std::unique_ptr<shm::ring_t>
+        open_ring(const mhaconfig_t & d, const std::string & name) {
+            std::unique_ptr<shm::ring_t> ring;
+            try {
+                ring = std::make_unique<shm::ring_t>
+                    (name, d.channels, 0U, 0.0, false);
+            } catch (std::exception & e) {
+                throw MHA_Error(__FILE__, __LINE__, "%s", e.what());
+            }
+            if ((ring->srate() / d.srate) >= 1.05 ||
+                (d.srate / ring->srate()) >= 1.05)
+                throw MHA_Error(__FILE__, __LINE__, "Shared memory \"%s\" has"
+                                " srate %f, expected %f", name.c_str(),
+                                ring->srate(), d.srate);
+            if (ring->capacity() < 2U * d.fragsize)
+                throw MHA_Error(__FILE__, __LINE__, "Shared memory \"%s\" holds"
+                                " only %u frames, need at least %u",
+                                name.c_str(), ring->capacity(), 2U*d.fragsize);
+            return ring;
+        }
+
+        /** Copies the oldest unread frames from the ring without waiting.
+         * Opens the ring again when its writer has restarted.
+         * @return number of frames received */
+        size_t pull_chunk(float * samples, double * timestamps,
+                          size_t max_frames) {
+            if (ring->stale())
+                reopen();
+            return ring->read(samples, timestamps, max_frames, read_index);
+        }
+
+        /** Replaces a stale ring by the one now published under name.
+         * Performs system calls and allocates, which only happens when
+         * the writer restarts, and then at most every reopen_interval
+         * blocks until it succeeds. */
+        void reopen() {
+            if (reopen_countdown > 0U) {
+                --reopen_countdown;
+                return;
+            }
+            try {
+                ring = open_ring(d, name);
+                read_index = ring->write_index();
+            } catch (MHA_Error &) {
+                reopen_countdown = reopen_interval;
+            }
+        }
+    };
+
+    /** Runtime configuration class of MHA plugin which receives audio
+        from a shared memory ring and resamples it to wav */
+    class cfg_t {
+    public:
+        /** Constructor
+         * @param d fragsize, srate, etc
+         * @param smoothed_time_base_name configured name of the dll plugin
+         *        which publishes the smoothed audio block start times, see
+         *        t::plugins::timebase::reader_t
+         * @param name of the shared memory segment to read
+         * @param concealment longest extrapolation of missing audio in s
+         */
+        cfg_t(const mhaconfig_t & d,
+              const std::string & smoothed_time_base_name,
+              const std::string & name,
+              double concealment,
+              algo_comm_t & ac)
+            : timebase(ac, smoothed_time_base_name, d.fragsize)
+            , playout(d, concealment, name)
+            , t0(0.0)
+            , dt(1/double(d.srate))
+        {
+        }
+
+        virtual ~cfg_t() = default;
+
+        timebase::reader_t timebase;
+        playout::playout_t<source_t> playout;
+        double t0;
+        double dt;
+
+        /** Replaces the signal with the audio from shared memory. */
+        virtual void process(mha_wave_t * s) {
+            update_signal_times();
+            playout.process(s, t0, dt);
+        }
+        void update_signal_times() {
+            timebase.next_block(t0, dt);
+        }
+    };
+
+    class if_t : public MHAPlugin::plugin_t<cfg_t> 
+    {
+    public:
+        /** Constructor
+         * @param algo_comm AC variable space */
+        if_t(algo_comm_t & algo_comm,
+             const std::string & /*configured_name*/)
+            : MHAPlugin::plugin_t<cfg_t>("Plays audio received via shared"
+                                         " memory", algo_comm)
+        {
+            insert_member(dll_plugin_name);
+            patchbay.connect(&dll_plugin_name.writeaccess, this, &if_t::update);
+            insert_member(shm_name);
+            patchbay.connect(&shm_name.writeaccess, this, &if_t::update);
+            insert_member(concealment);
+            patchbay.connect(&concealment.writeaccess, this, &if_t::update);
+        }
+
+        /** Process callback for processing time domain signal. Input signal
+         * is replaced. 
+         * @return unmodified pointer to input signal */
+        mha_wave_t * process(mha_wave_t * s) {
+            T_TRACE_SCOPE("shm2wav.process");
+            poll_config()->process(s);
+            return s;
+        }
+        /** Prepare for signal processing. */
+        void prepare(mhaconfig_t & /*signal_dimensions*/) {
+            update();
+        }
+        /** Empty implementation of release. */
+        void release() {}
+
+        /** Connects configuration events to actions. */
+        MHAEvents::patchbay_t<if_t> patchbay;
+
+        MHAParser::string_t dll_plugin_name =
+            {"Name of dll plugin name to access filtered block times", "dll"};
+
+        MHAParser::string_t shm_name =
+            {"Name of the POSIX shared memory segment to read","/wav2shm"};
+
+        MHAParser::float_t concealment =
+            {"Longest time in s for which missing audio is extrapolated from\n"
+             "the last received pitch period before it fades to silence.\n"
+             "0: silence", "0", "[0,1]"};
+
+        virtual void update(void) {
+            if (is_prepared())
+                push_config(new cfg_t(input_cfg(),
+                                      dll_plugin_name.data,
+                                      shm_name.data,
+                                      concealment.data,
+                                      ac));
+        }
+    };
+}
+
+MHAPLUGIN_CALLBACKS(shm2wav,t::plugins::shm2wav::if_t,wave,wave)
+
+MHAPLUGIN_DOCUMENTATION\
+(shm2wav,
+ "data-source time",
+ "Reads audio published by plugin wav2shm from a shared memory ring buffer"
+ " and uses the received samples to replace the sound, using the same"
+ " time-based playout as plugin lsl2wav"
+ )
+
+// Local variables:
+// compile-command: "make"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
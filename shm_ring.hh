@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace t::shm {
+
+    /** Layout of the header at the start of the shared memory segment.
+     * The header is followed by capacity*channels float samples
+     * (multiplexed) and by capacity double time stamps, aligned to 8
+     * bytes. */
+    struct ring_header_t {
+        /** Set to ring_magic last when the writer has initialized the
+         * segment. */
+        std::atomic<uint32_t> magic;
+        /** Layout version, ring_version */
+        uint32_t version;
+        /** Number of audio channels per frame */
+        uint32_t channels;
+        /** Number of frames that the ring can hold */
+        uint32_t capacity;
+        /** Nominal sampling rate of the audio frames / Hz */
+        double srate;
+        /** Incremented when a writer starts on this segment or abandons it
+         * for a segment of another size.  Readers stop reading when it
+         * changes and open the segment by name again. */
+        std::atomic<uint32_t> generation;
+        /** Total number of frames written since the writer started.
+         * Only the writer modifies this index. */
+        alignas(64) std::atomic<uint64_t> write_index;
+        /** Incremented after every write, readers wait on this word. */
+        alignas(64) std::atomic<uint32_t> futex_word;
+        /** Number of readers currently blocked in wait().  The writer
+         * only issues the FUTEX_WAKE system call when this is nonzero. */
+        std::atomic<uint32_t> waiters;
+    };
+
+    static constexpr uint32_t ring_magic = 0x64736872U; // "rhsd"
+    static constexpr uint32_t ring_version = 2U;
+
+    /** Single-writer, multi-reader lock-free ring buffer of timestamped
+     * audio frames in a named POSIX shared memory segment.
+     * Readers do not modify the ring except for the waiters counter, each
+     * reader keeps its own read index.  Readers that fall behind by more
+     * than the capacity detect the overrun and skip ahead.  A writer never
+     * resizes a segment that readers may have mapped: it continues a
+     * segment of the same size and replaces one of another size by a new
+     * segment under the same name. */
+    class ring_t {
+    public:
+        /** Create (writer) or open (reader) the shared memory segment.
+         * @param name Name of the POSIX shared memory object, see shm_open.
+         * @param channels Number of audio channels per frame
+         * @param capacity Number of frames in the ring (writer only,
+         *                 readers take the value from the segment)
+         * @param srate Nominal sampling rate (writer only)
+         * @param writer true when this instance writes to the ring
+         * @throw std::runtime_error if the segment cannot be created or
+         *        opened, or if an existing segment does not match. */
+        ring_t(const std::string & name, uint32_t channels, uint32_t capacity,
+               double srate, bool writer)
+        {
+            if (name.empty() || name[0] != '/')
+                throw std::runtime_error("shared memory name \"" + name +
+                                         "\" does not start with '/'");
+            int fd = shm_open(name.c_str(), writer ? (O_RDWR|O_CREAT) : O_RDWR,
+                              0660);
+            if (fd < 0)
+                throw std::runtime_error("cannot open shared memory \"" +
+                                         name + "\": " + strerror(errno));
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                close(fd);
+                throw std::runtime_error("cannot open shared memory \"" +
+                                         name + "\": " + strerror(errno));
+            }
+            size = st.st_size;
+            uint32_t generation_of_previous = 0U;
+            if (writer && size != bytes_needed(channels, capacity)) {
+                // Readers may map the old size: never truncate it
+                generation_of_previous = abandon(fd, size);
+                close(fd);
+                shm_unlink(name.c_str());
+                fd = shm_open(name.c_str(), O_RDWR|O_CREAT|O_EXCL, 0660);
+                size = bytes_needed(channels, capacity);
+                if (fd < 0 || ftruncate(fd, size) != 0) {
+                    const int error = errno;
+                    if (fd >= 0)
+                        close(fd);
+                    throw std::runtime_error("cannot create shared memory \""
+                                             + name + "\": " + strerror(error));
+                }
+            } else if (!writer && size < sizeof(ring_header_t)) {
+                close(fd);
+                throw std::runtime_error("shared memory \"" + name +
+                                         "\" is not initialized");
+            }
+            void * mem = mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_SHARED,
+                              fd, 0);
+            close(fd);
+            if (mem == MAP_FAILED)
+                throw std::runtime_error("cannot map shared memory \"" +
+                                         name + "\": " + strerror(errno));
+            header = static_cast<ring_header_t*>(mem);
+            const bool same_layout =
+                header->magic.load(std::memory_order_acquire) == ring_magic
+                && header->version == ring_version
+                && header->channels == channels
+                && size >= bytes_needed(header->channels, header->capacity);
+            if (writer && same_layout && header->capacity == capacity) {
+                // Restart: continue the frame index, readers validate again
+                header->srate = srate;
+                header->generation.fetch_add(1U);
+            } else if (writer) {
+                if (header->magic.load() == ring_magic)
+                    generation_of_previous = header->generation.load();
+                header->magic.store(0U);
+                header->version = ring_version;
+                header->channels = channels;
+                header->capacity = capacity;
+                header->srate = srate;
+                header->generation.store(generation_of_previous + 1U);
+                header->write_index.store(0U);
+                header->waiters.store(0U);
+                header->magic.store(ring_magic, std::memory_order_release);
+            } else if (!same_layout) {
+                munmap(mem, size);
+                throw std::runtime_error("shared memory \"" + name + "\" has"
+                                         " incompatible layout or channel"
+                                         " count");
+            }
+            generation = header->generation.load(std::memory_order_acquire);
+            samples = reinterpret_cast<float*>(header + 1);
+            timestamps = reinterpret_cast<double*>
+                (reinterpret_cast<char*>(header) +
+                 timestamps_offset(header->channels, header->capacity));
+        }
+        ring_t(const ring_t &) = delete;
+        ring_t & operator=(const ring_t &) = delete;
+        ~ring_t() {
+            munmap(header, size);
+        }
+
+        /** Offset of the time stamps from the start of the segment,
+         * aligned to 8 bytes. */
+        static size_t timestamps_offset(uint32_t channels, uint32_t capacity) {
+            const size_t end_of_samples = sizeof(ring_header_t)
+                + sizeof(float) * size_t(channels) * capacity;
+            return (end_of_samples + alignof(double) - 1U)
+                / alignof(double) * alignof(double);
+        }
+
+        /** Size of the shared memory segment for the given dimensions. */
+        static size_t bytes_needed(uint32_t channels, uint32_t capacity) {
+            return timestamps_offset(channels, capacity)
+                + sizeof(double) * size_t(capacity);
+        }
+
+        /** Append frames to the ring.  Writer only.  Wait-free, performs a
+         * system call only when a reader is blocked in wait().
+         * @param s multiplexed samples, frames * channels
+         * @param ts one time stamp per frame
+         * @param frames number of frames to write, <= capacity/2 so that
+         *        readers can detect frames overwritten while copying. */
+        void write(const float * s, const double * ts, size_t frames) {
+            const uint32_t channels = header->channels;
+            const uint32_t capacity = header->capacity;
+            uint64_t w = header->write_index.load(std::memory_order_relaxed);
+            for (size_t k = 0; k < frames; ++k, ++w) {
+                const size_t slot = w % capacity;
+                memcpy(samples + slot * channels, s + k * channels,
+                       sizeof(float) * channels);
+                timestamps[slot] = ts[k];
+            }
+            header->write_index.store(w);
+            header->futex_word.fetch_add(1U);
+            if (header->waiters.load() != 0U)
+                syscall(SYS_futex, &header->futex_word, FUTEX_WAKE, INT_MAX,
+                        nullptr, nullptr, 0);
+        }
+
+        /** Copy the oldest unread frames out of the ring.  Never blocks.
+         * @param s destination for multiplexed samples
+         * @param ts destination for time stamps
+         * @param max_frames capacity of the destinations in frames
+         * @param read_index the reader's total frame index, advanced by the
+         *        number of frames returned.  When the reader has fallen
+         *        behind by more than half the capacity, or when the writer has
+         *        restarted, the index is moved to recent data.
+         * @return number of frames copied, 0 when stale() */
+        size_t read(float * s, double * ts, size_t max_frames,
+                    uint64_t & read_index) const {
+            const uint32_t channels = header->channels;
+            const uint32_t capacity = header->capacity;
+            for (unsigned attempt = 0; attempt < 2U; ++attempt) {
+                if (stale())
+                    return 0U;
+                uint64_t w = header->write_index.load();
+                if (w < read_index || w - read_index > capacity / 2)
+                    read_index = w - std::min<uint64_t>(w, capacity / 2);
+                size_t frames = std::min<uint64_t>(w - read_index, max_frames);
+                for (size_t k = 0; k < frames; ++k) {
+                    const size_t slot = (read_index + k) % capacity;
+                    memcpy(s + k * channels, samples + slot * channels,
+                           sizeof(float) * channels);
+                    ts[k] = timestamps[slot];
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                // Overwritten by the writer while copying?  Then retry.  The
+                // writer may be filling up to capacity/2 unpublished frames.
+                if (header->write_index.load() - read_index
+                    <= capacity - capacity / 2) {
+                    read_index += frames;
+                    return frames;
+                }
+            }
+            return 0U;
+        }
+
+        /** Block until frames beyond read_index are available or the
+         * timeout expires.  Not for use in the audio processing thread.
+         * @param read_index the reader's total frame index
+         * @param timeout relative timeout, nullptr waits indefinitely
+         * @return true if new frames are available */
+        bool wait(uint64_t read_index, const struct timespec * timeout) const {
+            if (header->write_index.load() != read_index)
+                return true;
+            header->waiters.fetch_add(1U);
+            uint32_t seq = header->futex_word.load();
+            if (header->write_index.load() == read_index)
+                syscall(SYS_futex, &header->futex_word, FUTEX_WAIT, seq,
+                        timeout, nullptr, 0);
+            header->waiters.fetch_sub(1U);
+            return header->write_index.load() != read_index;
+        }
+
+        /** Total number of frames written since the writer started. */
+        uint64_t write_index() const {
+            return header->write_index.load();
+        }
+
+        /** Nominal sampling rate stored by the writer / Hz */
+        double srate() const {return header->srate;}
+
+        /** Number of frames in the ring */
+        uint32_t capacity() const {return header->capacity;}
+
+        /** @return true when a writer has started since this instance
+         * opened the segment.  Readers then open the segment by name
+         * again to see its current size and sampling rate. */
+        bool stale() const {
+            return header->generation.load(std::memory_order_acquire)
+                != generation;
+        }
+
+    private:
+        /** Marks an existing ring as stale for its readers.
+         * @return its generation, 0 if it is no valid ring */
+        static uint32_t abandon(int fd, size_t size) {
+            if (size < sizeof(ring_header_t))
+                return 0U;
+            void * mem = mmap(nullptr, sizeof(ring_header_t),
+                              PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+            if (mem == MAP_FAILED)
+                return 0U;
+            ring_header_t * old = static_cast<ring_header_t*>(mem);
+            uint32_t generation = 0U;
+            if (old->magic.load(std::memory_order_acquire) == ring_magic)
+                generation = old->generation.fetch_add(1U) + 1U;
+            munmap(mem, sizeof(ring_header_t));
+            return generation;
+        }
+
+        uint32_t generation = {0U};
+        size_t size = {0U};
+        ring_header_t * header = {nullptr};
+        float * samples = {nullptr};
+        double * timestamps = {nullptr};
+    };
+}
+// Local variables:
+// compile-command: "make"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
@@ -0,0 +1,173 @@
+// Publishes the time base of plugin dll in a named POSIX shared memory
+// segment.  Other processes on the same host, e.g. logging, video or
+// network daemons, include this header and read the time base wait-free,
+// without openMHA and without any request to the writer.
+
+#ifndef T_SHM_TIMEBASE_HH
+#define T_SHM_TIMEBASE_HH
+
+#include "timebase.hh"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace t::shm {
+
+    /** Layout of the shared memory segment of a time base. */
+    struct timebase_header_t {
+        /** Set to timebase_magic last when the writer has initialized the
+         * segment. */
+        std::atomic<uint32_t> magic;
+        /** Layout version, timebase_version */
+        uint32_t version;
+        /** The published time base, on its own cache line */
+        alignas(64) timing::timebase_seqlock_t seqlock;
+    };
+
+    static constexpr uint32_t timebase_magic = 0x64736274U; // "tbsd"
+    static constexpr uint32_t timebase_version = 2U;
+
+    /** A time base in a named POSIX shared memory segment, written by one
+     * process and read by any number of processes.  The writer holds an
+     * exclusive flock on the segment as long as it exists, so that a
+     * second writer, e.g. a second dll configured with the same name,
+     * fails instead of interleaving its blocks.  Readers map the segment
+     * read-only. */
+    class timebase_t {
+    public:
+        /** Create or continue (writer) or open (reader) the segment.  A
+         * writer continues the sequence of an existing segment with the
+         * same layout, so that readers see a restarted writer as one
+         * that skipped some blocks.  A segment of another size is
+         * replaced by a new one, readers of the old one see a stopped
+         * writer.
+         * @param name Name of the POSIX shared memory object, see shm_open.
+         * @param writer true when this instance publishes the time base
+         * @throw std::runtime_error if the segment cannot be created or
+         *        opened, if an existing segment does not match, or if
+         *        another writer holds it. */
+        timebase_t(const std::string & name, bool writer)
+        {
+            if (name.empty() || name[0] != '/')
+                throw std::runtime_error("shared memory name \"" + name +
+                                         "\" does not start with '/'");
+            int fd = shm_open(name.c_str(), writer ? (O_RDWR|O_CREAT)
+                              : O_RDONLY, 0644);
+            if (fd < 0)
+                throw std::runtime_error("cannot open shared memory \"" +
+                                         name + "\": " + strerror(errno));
+            if (writer)
+                lock(fd, name);
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                const int error = errno;
+                close(fd);
+                throw std::runtime_error("cannot open shared memory \"" +
+                                         name + "\": " + strerror(error));
+            }
+            if (writer && st.st_size != 0 &&
+                size_t(st.st_size) != sizeof(timebase_header_t)) {
+                // Readers may map the old size: never truncate it
+                close(fd);
+                shm_unlink(name.c_str());
+                fd = shm_open(name.c_str(), O_RDWR|O_CREAT|O_EXCL, 0644);
+                if (fd < 0)
+                    throw std::runtime_error("cannot create shared memory \""
+                                             + name + "\": " + strerror(errno));
+                lock(fd, name);
+                st.st_size = 0;
+            }
+            if (writer && st.st_size == 0 &&
+                ftruncate(fd, sizeof(timebase_header_t)) != 0) {
+                const int error = errno;
+                close(fd);
+                throw std::runtime_error("cannot resize shared memory \"" +
+                                         name + "\": " + strerror(error));
+            }
+            if (!writer && size_t(st.st_size) < sizeof(timebase_header_t)) {
+                close(fd);
+                throw std::runtime_error("shared memory \"" + name +
+                                         "\" is not initialized");
+            }
+            void * mem = mmap(nullptr, sizeof(timebase_header_t),
+                              writer ? (PROT_READ|PROT_WRITE) : PROT_READ,
+                              MAP_SHARED, fd, 0);
+            if (mem == MAP_FAILED) {
+                const int error = errno;
+                close(fd);
+                throw std::runtime_error("cannot map shared memory \"" +
+                                         name + "\": " + strerror(error));
+            }
+            // The writer keeps the descriptor and thereby its lock
+            if (writer)
+                lock_fd = fd;
+            else
+                close(fd);
+            header = static_cast<timebase_header_t*>(mem);
+            const bool initialized =
+                header->magic.load(std::memory_order_acquire) ==
+                timebase_magic && header->version == timebase_version;
+            if (writer && !initialized) {
+                header->magic.store(0U);
+                header->version = timebase_version;
+                header->seqlock.reset();
+                header->magic.store(timebase_magic, std::memory_order_release);
+            } else if (!initialized) {
+                munmap(mem, sizeof(timebase_header_t));
+                throw std::runtime_error("shared memory \"" + name + "\" has"
+                                         " incompatible layout");
+            }
+        }
+        timebase_t(const timebase_t &) = delete;
+        timebase_t & operator=(const timebase_t &) = delete;
+        ~timebase_t() {
+            munmap(header, sizeof(timebase_header_t));
+            if (lock_fd >= 0)
+                close(lock_fd);
+        }
+
+        /** Publishes a new snapshot.  Writer only, wait-free, no system
+         * call. */
+        void write(const timing::timebase_snapshot_t & s) {
+            header->seqlock.write(s);
+        }
+
+        /** Copies the latest snapshot.  Wait-free, no system call.
+         * @return false if no consistent snapshot could be read */
+        bool read(timing::timebase_snapshot_t & s) const {
+            return header->seqlock.read(s);
+        }
+
+    private:
+        /** Takes the exclusive lock of the writer, closes fd on failure.
+         * @throw std::runtime_error if another writer holds the lock */
+        static void lock(int fd, const std::string & name) {
+            if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+                const std::string reason = errno == EWOULDBLOCK ?
+                    "written by another instance" : strerror(errno);
+                close(fd);
+                throw std::runtime_error("shared memory \"" + name +
+                                         "\" is " + reason);
+            }
+        }
+
+        timebase_header_t * header = {nullptr};
+        /** Descriptor holding the flock of the writer, -1 for readers */
+        int lock_fd = {-1};
+    };
+}
+
+#endif
+
+// Local variables:
+// compile-command: "make"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
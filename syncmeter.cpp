@@ -0,0 +1,174 @@
+#include "syncmeter.hh"
+#include "trace.hh"
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace t::plugins::syncmeter {
+
+    class if_t : public MHAPlugin::plugin_t<cfg_t>
+    {
+    public:
+        /** Constructor publishes the result AC variables.
+         * @param algo_comm AC variable space
+         * @param configured_name Loaded name of plugin, used as AC variable
+         *        base name */
+        if_t(algo_comm_t & algo_comm, const std::string & configured_name)
+            : MHAPlugin::plugin_t<cfg_t>("Measures the time offset between a"
+                                         " local signal from an AC variable"
+                                         " and the input signal, e.g. a"
+                                         " remote signal received by lsl2wav."
+                                         "  Publishes AC variables " +
+                                         configured_name + "_offset (s) and "
+                                         + configured_name + "_quality",
+                                         algo_comm)
+            , offset_ac(algo_comm, configured_name + "_offset",
+                        std::numeric_limits<double>::quiet_NaN())
+            , quality_ac(algo_comm, configured_name + "_quality", 0.0)
+        {
+            insert_member(reference);
+            patchbay.connect(&reference.writeaccess, this, &if_t::update);
+            insert_member(channel);
+            patchbay.connect(&channel.writeaccess, this, &if_t::update);
+            insert_member(window);
+            patchbay.connect(&window.writeaccess, this, &if_t::update);
+            insert_member(max_lag);
+            patchbay.connect(&max_lag.writeaccess, this, &if_t::update);
+            insert_member(interval);
+            patchbay.connect(&interval.writeaccess, this, &if_t::update);
+        }
+
+        /** Stops the worker thread if release was not called. */
+        ~if_t() {
+            stop_worker();
+        }
+
+        /** Process callback, signal is not modified.
+         * @return unmodified pointer to input signal */
+        mha_wave_t * process(mha_wave_t * s) {
+            T_TRACE_SCOPE("syncmeter.process");
+            cfg_t * cfg = poll_config();
+            cfg->process(s);
+            offset_ac.data = cfg->offset;
+            quality_ac.data = cfg->quality;
+            return s;
+        }
+        /** Prepare for signal processing, starts the worker thread. */
+        void prepare(mhaconfig_t & /*signal_dimensions*/) {
+            offset_ac.data = std::numeric_limits<double>::quiet_NaN();
+            quality_ac.data = 0.0;
+            update();
+            stop = false;
+            worker = std::thread(&if_t::measure_loop, this);
+        }
+        /** Stops the worker thread. */
+        void release() {
+            stop_worker();
+        }
+
+        /** Connects configuration events to actions. */
+        MHAEvents::patchbay_t<if_t> patchbay;
+
+        /** Offset of the input signal behind the local signal in seconds,
+         * published as AC variable */
+        MHA_AC::double_t offset_ac;
+
+        /** Normalized cross-correlation at the peak, published as AC
+         * variable.  Values near 1 indicate a reliable offset. */
+        MHA_AC::double_t quality_ac;
+
+        MHAParser::string_t reference =
+            {"Name of the AC variable holding the local signal, e.g. stored\n"
+             "by openMHA plugin wave2ac before lsl2wav replaces the signal",
+             "local"};
+
+        MHAParser::int_t channel =
+            {"Channel of the local and input signals that is compared",
+             "0", "[0,]"};
+
+        MHAParser::float_t window =
+            {"Duration of the correlated signal segments in s", "1", "]0,]"};
+
+        MHAParser::float_t max_lag =
+            {"Largest offset that is searched in s", "0.1", "]0,]"};
+
+        MHAParser::float_t interval =
+            {"Time between two measurements in s", "0.5", "]0,]"};
+
+        virtual void update(void) {
+            if (is_prepared()) {
+                cfg_t * cfg = new cfg_t(input_cfg(),
+                                        reference.data,
+                                        channel.data,
+                                        window.data,
+                                        max_lag.data,
+                                        interval.data,
+                                        ac);
+                // push_config deletes configurations that the processing
+                // thread no longer uses, never the latest one
+                std::lock_guard<std::mutex> lock(latest_mutex);
+                push_config(cfg);
+                latest = cfg;
+            }
+        }
+
+    private:
+        /** Worker thread: measures the offset with the latest
+         * configuration every interval seconds. */
+        void measure_loop() {
+            auto next = std::chrono::steady_clock::now();
+            while (!stop) {
+                double interval;
+                {
+                    std::lock_guard<std::mutex> lock(latest_mutex);
+                    interval = latest->interval;
+                }
+                next += std::chrono::duration_cast
+                    <std::chrono::steady_clock::duration>
+                    (std::chrono::duration<double>(interval));
+                // Sleep in short slices to stop quickly on release
+                while (!stop && std::chrono::steady_clock::now() < next)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                if (stop)
+                    break;
+                std::lock_guard<std::mutex> lock(latest_mutex);
+                latest->measure();
+            }
+        }
+        void stop_worker() {
+            stop = true;
+            if (worker.joinable())
+                worker.join();
+        }
+
+        /** Protects latest against deletion by push_config while the
+         * worker uses it.  Never taken by the processing thread. */
+        std::mutex latest_mutex;
+        /** Configuration pushed last, measured by the worker */
+        cfg_t * latest = {nullptr};
+        std::atomic<bool> stop = {false};
+        std::thread worker;
+    };
+}
+
+MHAPLUGIN_CALLBACKS(syncmeter,t::plugins::syncmeter::if_t,wave,wave)
+
+MHAPLUGIN_DOCUMENTATION\
+(syncmeter,
+ "acvariables time",
+ "Measures the time offset between a local signal and the input signal,"
+ " e.g. the local metronome and the metronome of another node received"
+ " by lsl2wav.  The local signal is read from an AC variable.  A worker"
+ " thread cross-correlates the latest window of both signals via FFT and"
+ " interpolates the correlation peak with a parabola for sub-sample"
+ " resolution.  The offset is published as AC variable <name>_offset in"
+ " seconds (positive if the input lags behind the local signal), the"
+ " normalized correlation peak as <name>_quality."
+ )
+
+// Local variables:
+// compile-command: "make"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
@@ -0,0 +1,220 @@
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <mha_plugin.hh>
+#include <mha_signal.hh>
+#include <mha_fft.h>
+
+namespace t::plugins::syncmeter {
+
+    /** Single-producer single-consumer history of two mono signals.  The
+     * processing thread appends, the worker thread copies the most recent
+     * samples without locks and detects when they were overwritten during
+     * the copy. */
+    class history_t {
+    public:
+        /** @param capacity number of samples kept per signal, power of 2
+         * @param in_flight samples that the processing thread may append
+         *        before it publishes them, the fragsize */
+        history_t(size_t capacity, size_t in_flight)
+            : local(capacity, 0.0f), remote(capacity, 0.0f)
+            , in_flight(in_flight)
+        {}
+        std::vector<float> local, remote;
+        const size_t in_flight;
+        /** Total number of samples appended */
+        std::atomic<uint64_t> write_index = {0U};
+
+        /** Appends one sample of each signal.  Processing thread only. */
+        void append(float local_sample, float remote_sample, uint64_t index) {
+            local[index & (local.size() - 1U)] = local_sample;
+            remote[index & (remote.size() - 1U)] = remote_sample;
+        }
+        /** Publishes the samples appended up to index.  Processing thread. */
+        void publish(uint64_t index) {
+            write_index.store(index, std::memory_order_release);
+        }
+        /** Copies the latest count samples of both signals.  Worker thread.
+         * @return true if the copy is consistent */
+        bool latest(float * local_out, float * remote_out,
+                    size_t count) const {
+            const uint64_t end = write_index.load(std::memory_order_acquire);
+            if (end < count || count + in_flight > local.size())
+                return false;
+            for (size_t k = 0; k < count; ++k) {
+                const size_t index = (end - count + k) & (local.size() - 1U);
+                local_out[k] = local[index];
+                remote_out[k] = remote[index];
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            // The writer may have wrapped around into the copied range,
+            // including the samples of the block it has not published yet
+            return write_index.load(std::memory_order_relaxed) - end
+                <= local.size() - count - in_flight;
+        }
+    };
+
+    /** Runtime configuration class of MHA plugin which measures the time
+        offset between a local and a remote signal by cross-correlation. */
+    class cfg_t {
+    public:
+        /** Constructor allocates all buffers.
+         * @param signal_dimensions fragsize, srate, etc
+         * @param reference_name AC variable holding the local signal, e.g.
+         *        stored by openMHA plugin wave2ac
+         * @param channel channel of both signals that is compared
+         * @param window duration of the correlated signal segments in s
+         * @param max_lag largest offset that is searched in s
+         * @param interval time between two measurements in s
+         * @param ac AC variable space */
+        cfg_t(const mhaconfig_t & signal_dimensions,
+              const std::string & reference_name,
+              unsigned channel,
+              double window,
+              double max_lag,
+              double interval,
+              algo_comm_t & ac)
+            : reference_name(reference_name)
+            , channel(channel)
+            , srate(signal_dimensions.srate)
+            , window_length(std::max(size_t(window * srate), size_t(2U)))
+            , max_lag(std::min(size_t(max_lag * srate), window_length - 1U))
+            , fftlen(power_of_two(2U * window_length))
+            , interval(interval)
+            , ac(ac)
+            , history(power_of_two(2U * window_length +
+                                   4U * signal_dimensions.fragsize),
+                      signal_dimensions.fragsize)
+            , local(fftlen, 1U), remote(fftlen, 1U)
+            , raw_remote(window_length, 0.0f)
+            , local_spec(fftlen / 2U + 1U, 1U)
+            , remote_spec(fftlen / 2U + 1U, 1U)
+            , fft(mha_fft_new(fftlen))
+        {
+            if (channel >= signal_dimensions.channels)
+                throw MHA_Error(__FILE__, __LINE__, "channel %u does not exist"
+                                " in signal with %u channels", channel,
+                                signal_dimensions.channels);
+        }
+
+        virtual ~cfg_t() {
+            mha_fft_free(fft);
+        }
+
+        const std::string reference_name;
+        const unsigned channel;
+        const double srate;
+        /** Number of samples in the correlated segments */
+        const size_t window_length;
+        /** Largest searched lag in samples */
+        const size_t max_lag;
+        /** FFT length, at least twice the window to avoid circular wrap */
+        const unsigned fftlen;
+        const double interval;
+        algo_comm_t & ac;
+
+        history_t history;
+        /** Samples appended by the processing thread */
+        uint64_t samples = {0U};
+
+        /** Latest measured offset in s: positive if the remote signal lags
+         * behind the local signal.  NaN before the first measurement. */
+        std::atomic<double> offset = {std::numeric_limits<double>::quiet_NaN()};
+        /** Normalized cross-correlation at the peak, 0..1 */
+        std::atomic<double> quality = {0.0};
+
+        /** Worker thread buffers */
+        MHASignal::waveform_t local, remote;
+        std::vector<float> raw_remote;
+        MHASignal::spectrum_t local_spec, remote_spec;
+        mha_fft_t fft;
+
+        static unsigned power_of_two(size_t n) {
+            unsigned p = 1U;
+            while (p < n)
+                p *= 2U;
+            return p;
+        }
+
+        /** Appends the selected channel of the local signal from the AC
+         * variable and of the remote signal s to the history.  Processing
+         * thread, no allocations, no locks. */
+        virtual void process(mha_wave_t * s) {
+            const mha_real_t * reference = nullptr;
+            unsigned stride = 0U;
+            if (ac.is_var(reference_name)) {
+                comm_var_t cv = ac.get_var(reference_name);
+                if (cv.data_type == MHA_AC_MHAREAL && cv.data != nullptr &&
+                    cv.stride > channel &&
+                    cv.num_entries >= s->num_frames * cv.stride) {
+                    reference = static_cast<const mha_real_t *>(cv.data);
+                    stride = cv.stride;
+                }
+            }
+            for (unsigned k = 0; k < s->num_frames; ++k, ++samples)
+                history.append(reference ? reference[k * stride + channel]
+                               : 0.0f, value(s, k, channel), samples);
+            history.publish(samples);
+        }
+
+        /** Cross-correlates the latest window of both signals via FFT and
+         * interpolates the peak position with a parabola.  Worker thread. */
+        void measure() {
+            local.assign(0.0f);
+            remote.assign(0.0f);
+            if (!history.latest(local.buf, remote.buf, window_length))
+                return;
+            std::copy(remote.buf, remote.buf + window_length,
+                      raw_remote.begin());
+            double energy_local = 0.0, energy_remote = 0.0;
+            for (size_t k = 0; k < window_length; ++k) {
+                energy_local += double(local.buf[k]) * local.buf[k];
+                energy_remote += double(remote.buf[k]) * remote.buf[k];
+            }
+            if (energy_local <= 0.0 || energy_remote <= 0.0)
+                return;
+            mha_fft_wave2spec(fft, &local, &local_spec);
+            mha_fft_wave2spec(fft, &remote, &remote_spec);
+            // conj(L) * R: correlation r[k] = sum_n l[n] r[n+k]
+            for (unsigned f = 0; f < local_spec.num_frames; ++f) {
+                const mha_complex_t l = local_spec.buf[f];
+                const mha_complex_t r = remote_spec.buf[f];
+                remote_spec.buf[f].re = l.re * r.re + l.im * r.im;
+                remote_spec.buf[f].im = l.re * r.im - l.im * r.re;
+            }
+            mha_fft_spec2wave(fft, &remote_spec, &remote);
+            auto correlation = [&](long lag) {
+                return remote.buf[lag >= 0 ? lag : long(fftlen) + lag];
+            };
+            long peak = -long(max_lag);
+            for (long lag = peak + 1; lag <= long(max_lag); ++lag)
+                if (correlation(lag) > correlation(peak))
+                    peak = lag;
+            double fraction = 0.0;
+            if (peak > -long(max_lag) && peak < long(max_lag)) {
+                const double left = correlation(peak - 1);
+                const double center = correlation(peak);
+                const double right = correlation(peak + 1);
+                const double curvature = left - 2 * center + right;
+                if (curvature < 0.0)
+                    fraction = 0.5 * (left - right) / curvature;
+            }
+            // Normalized correlation at the peak, computed directly so that
+            // the scaling of the FFT implementation does not matter
+            double peak_correlation = 0.0;
+            for (long k = std::max(0L, -peak);
+                 k < long(window_length) && k + peak < long(window_length);
+                 ++k)
+                peak_correlation += double(local.buf[k]) * raw_remote[k+peak];
+            quality = peak_correlation / std::sqrt(energy_local * energy_remote);
+            offset = (peak + fraction) / srate;
+        }
+    };
+}
+// Local variables:
+// compile-command: "make"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
@@ -0,0 +1,149 @@
+// Time base of an audio stream as published by plugin dll: the filtered
+// times of the current block and the loop period, from which any process
+// maps sample indices to times and back.  Independent of openMHA, used
+// inside openMHA and by other processes, see shm_timebase.hh.
+
+#ifndef T_TIMEBASE_HH
+#define T_TIMEBASE_HH
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <time.h>
+
+namespace t::timing {
+
+    /** One consistent state of the time base. */
+    struct timebase_snapshot_t {
+        /** Filtered start times of the current and the next block / s */
+        double t0 = std::numeric_limits<double>::quiet_NaN();
+        double t1 = std::numeric_limits<double>::quiet_NaN();
+
+        /** Filtered duration of the current block / s.  Not computed from
+         * t1 - t0, which is only resolved to 0.24 us. */
+        double period = std::numeric_limits<double>::quiet_NaN();
+
+        /** Adjustment included in t0 and t1 / s: the writer processed the
+         * block starting at n0 at about t0 - adjustment */
+        double adjustment = {0.0};
+
+        /** Total sample indices of the first samples of both blocks,
+         * n1 == 0 if nothing was published yet */
+        uint64_t n0 = {0U};
+        uint64_t n1 = {0U};
+
+        /** Clock of the times, for clock_gettime */
+        int32_t clock = {CLOCK_REALTIME};
+
+        /** Nonzero when the loop has settled after acquiring lock */
+        uint32_t locked = {0U};
+
+        /** Even number that changes with every published block, readers
+         * compare it to detect a stopped writer */
+        uint32_t sequence = {0U};
+
+        /** @return the time of a total sample index / s, NaN if nothing
+         * was published yet */
+        double time_of(double sample_index) const {
+            return t0 + (sample_index - n0) * period / (n1 - n0);
+        }
+
+        /** @return the total sample index at a time of clock */
+        double sample_at(double time) const {
+            return n0 + (time - t0) * (n1 - n0) / period;
+        }
+
+        /** @return rate of the samples per second of clock */
+        double rate() const {return (n1 - n0) / period;}
+
+        /** @return the current time of clock / s, NaN on error */
+        double now() const {
+            struct timespec ts = {.tv_sec = 0, .tv_nsec = 0};
+            if (clock_gettime(clock, &ts) != 0)
+                return std::numeric_limits<double>::quiet_NaN();
+            return ts.tv_sec + ts.tv_nsec * 1e-9;
+        }
+    };
+
+    /** Seqlock around a snapshot: one writer, any number of readers which
+     * never block the writer.  All members are lock-free atomics, so that
+     * the seqlock can live in memory shared between processes. */
+    struct timebase_seqlock_t {
+        static_assert(std::atomic<double>::is_always_lock_free &&
+                      std::atomic<uint64_t>::is_always_lock_free,
+                      "shared memory needs lock-free atomics");
+
+        /** Odd while the writer modifies the fields */
+        std::atomic<uint32_t> sequence;
+        std::atomic<double> t0, t1, period, adjustment;
+        std::atomic<uint64_t> n0, n1;
+        std::atomic<int32_t> clock;
+        std::atomic<uint32_t> locked;
+
+        /** Number of attempts of read() before it gives up */
+        static constexpr unsigned attempts = 64U;
+
+        /** Publishes a new snapshot.  Writer only, wait-free.  The
+         * sequence member of s is ignored.  Also restores an odd sequence
+         * left by a writer that died while writing. */
+        void write(const timebase_snapshot_t & s) {
+            const uint32_t odd = sequence.load(std::memory_order_relaxed) | 1U;
+            sequence.store(odd, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            t0.store(s.t0, std::memory_order_relaxed);
+            t1.store(s.t1, std::memory_order_relaxed);
+            period.store(s.period, std::memory_order_relaxed);
+            adjustment.store(s.adjustment, std::memory_order_relaxed);
+            n0.store(s.n0, std::memory_order_relaxed);
+            n1.store(s.n1, std::memory_order_relaxed);
+            clock.store(s.clock, std::memory_order_relaxed);
+            locked.store(s.locked, std::memory_order_relaxed);
+            sequence.store(odd + 1U, std::memory_order_release);
+        }
+
+        /** Copies the latest snapshot.  Wait-free: retries at most
+         * attempts times while the writer publishes a new one.
+         * @return false if no consistent snapshot could be read, e.g.
+         *         because the writer was preempted while writing; s is
+         *         unchanged then */
+        bool read(timebase_snapshot_t & s) const {
+            for (unsigned attempt = 0; attempt < attempts; ++attempt) {
+                const uint32_t seq = sequence.load(std::memory_order_acquire);
+                if (seq & 1U)
+                    continue;
+                timebase_snapshot_t copy;
+                copy.t0 = t0.load(std::memory_order_relaxed);
+                copy.t1 = t1.load(std::memory_order_relaxed);
+                copy.period = period.load(std::memory_order_relaxed);
+                copy.adjustment = adjustment.load(std::memory_order_relaxed);
+                copy.n0 = n0.load(std::memory_order_relaxed);
+                copy.n1 = n1.load(std::memory_order_relaxed);
+                copy.clock = clock.load(std::memory_order_relaxed);
+                copy.locked = locked.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (sequence.load(std::memory_order_relaxed) == seq) {
+                    copy.sequence = seq;
+                    s = copy;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /** Puts the seqlock into the state of "nothing published".  Not
+         * thread-safe, for initialization only. */
+        void reset() {
+            write(timebase_snapshot_t());
+            sequence.store(0U, std::memory_order_release);
+        }
+    };
+}
+
+#endif
+
+// Local variables:
+// compile-command: "make"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
@@ -1,29 +1,19 @@
-#include <time.h>
 #include "timestamper.hh"
+#include "timing.hh"
+#include "trace.hh"
 
 namespace timestamper = t::plugins::timestamper;
 
 timestamper::cfg_t::cfg_t(const std::string & clock_source_name)
 {
-#define checkassignclocksource(whichclock) \
-    if (clock_source_name == #whichclock)  \
-        clock_source = whichclock;
-    checkassignclocksource(CLOCK_REALTIME);
-    checkassignclocksource(CLOCK_REALTIME_COARSE);
-    checkassignclocksource(CLOCK_MONOTONIC);
-    checkassignclocksource(CLOCK_MONOTONIC_COARSE);
-    checkassignclocksource(CLOCK_MONOTONIC_RAW);
-    checkassignclocksource(CLOCK_BOOTTIME);
-    checkassignclocksource(CLOCK_PROCESS_CPUTIME_ID);
-    checkassignclocksource(CLOCK_THREAD_CPUTIME_ID);
+    if (!t::timing::clock_id(clock_source_name, clock_source))
+        throw MHA_Error(__FILE__, __LINE__, "Unknown clock source \"%s\"",
+                        clock_source_name.c_str());
 }
 
 double timestamper::cfg_t::process()
 {
-    struct timespec timespec = {.tv_sec = 0, .tv_nsec = 0};
-    if (clock_gettime(clock_source, &timespec) == 0)
-        return timespec.tv_sec + timespec.tv_nsec * 1e-9;
-    return std::numeric_limits<double>::quiet_NaN();
+    return t::timing::get_time(clock_source);
 }
 
 timestamper::if_t::if_t(algo_comm_t & algo_comm,
@@ -53,6 +43,7 @@ void timestamper::if_t::update()
 template<class mha_signal_t>
 mha_signal_t* timestamper::if_t::process(mha_signal_t* s)
 {
+    T_TRACE_SCOPE("timestamper.process");
     time.data = poll_config()->process();
     return s;
 }
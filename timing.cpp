@@ -0,0 +1,408 @@
+// Implementation of the timing core and of its C API.  Must not include
+// openMHA headers: libttiming is used by programs without openMHA.
+
+#include "timing.hh"
+#include <new>
+#include <stdexcept>
+
+namespace timing = t::timing;
+
+namespace {
+    /** Creates the estimator policy selected by name */
+    std::variant<timing::dll_estimator_t, timing::kalman_estimator_t,
+                 timing::rls_estimator_t>
+    make_estimator(std::string_view name, double b, double c,
+                   double omega, double tper, double F, double B)
+    {
+        if (name == "kalman")
+            return timing::kalman_estimator_t(omega, tper);
+        if (name == "rls")
+            return timing::rls_estimator_t(F / (2 * B));
+        return timing::dll_estimator_t(b, c);
+    }
+
+    /** Translates pre-filter names to modes, nullptr if unknown */
+    const timing::prefilter_t::mode_t * prefilter_mode(std::string_view name)
+    {
+        static const timing::prefilter_t::mode_t modes[] =
+            {timing::prefilter_t::NONE, timing::prefilter_t::PAIR,
+             timing::prefilter_t::MEDIAN3, timing::prefilter_t::MEDIAN5};
+        static const std::string_view names[] =
+            {"none", "pair", "median3", "median5"};
+        for (unsigned i = 0; i < 4U; ++i)
+            if (name == names[i])
+                return &modes[i];
+        return nullptr;
+    }
+
+    /** @return params
+     * @throw std::invalid_argument if params are invalid */
+    const ttiming_params_t & checked(const ttiming_params_t & params)
+    {
+        if (const char * error = timing::dll_t::check(params))
+            throw std::invalid_argument(error);
+        return params;
+    }
+
+    /** @return the offset clock id, false if name is "none" */
+    bool offset_clock_id(const char * name, clockid_t & clock)
+    {
+        return std::string_view(name) != "none" &&
+            timing::clock_id(name, clock);
+    }
+}
+
+bool timing::clock_id(std::string_view clock_name, clockid_t & clock)
+{
+#define checkassignclocksource(whichclock) \
+    if (clock_name == #whichclock) {       \
+        clock = whichclock;                \
+        return true;                       \
+    }
+    checkassignclocksource(CLOCK_REALTIME);
+    checkassignclocksource(CLOCK_REALTIME_COARSE);
+    checkassignclocksource(CLOCK_MONOTONIC);
+    checkassignclocksource(CLOCK_MONOTONIC_COARSE);
+    checkassignclocksource(CLOCK_MONOTONIC_RAW);
+    checkassignclocksource(CLOCK_BOOTTIME);
+    checkassignclocksource(CLOCK_PROCESS_CPUTIME_ID);
+    checkassignclocksource(CLOCK_THREAD_CPUTIME_ID);
+#undef checkassignclocksource
+    return false;
+}
+
+double timing::get_time(clockid_t clock)
+{
+    struct timespec timespec = {.tv_sec = 0, .tv_nsec = 0};
+    if (clock_gettime(clock, &timespec) == 0)
+        return timespec.tv_sec + timespec.tv_nsec * 1e-9;
+    return std::numeric_limits<double>::quiet_NaN();
+}
+
+const char * timing::dll_t::check(const ttiming_params_t & params)
+{
+    clockid_t clock;
+    if (!(params.srate > 0) || params.fragsize == 0U)
+        return "srate and fragsize must be positive";
+    if (!(params.bandwidth > 0))
+        return "bandwidth must be positive";
+    if (params.clock_source == nullptr ||
+        !clock_id(params.clock_source, clock))
+        return "unknown clock_source";
+    if (params.offset_clock == nullptr ||
+        (std::string_view(params.offset_clock) != "none" &&
+         !clock_id(params.offset_clock, clock)))
+        return "unknown offset_clock";
+    if (!(params.offset_bandwidth > 0) || !(params.step_threshold > 0))
+        return "offset_bandwidth and step_threshold must be positive";
+    if (params.estimator == nullptr ||
+        (std::string_view(params.estimator) != "dll" &&
+         std::string_view(params.estimator) != "kalman" &&
+         std::string_view(params.estimator) != "rls"))
+        return "unknown estimator";
+    if (params.prefilter == nullptr || !prefilter_mode(params.prefilter))
+        return "unknown prefilter";
+    if (!(params.outlier_clip >= 0))
+        return "outlier_clip must not be negative";
+    if (!(params.bandwidth_min > 0) || !(params.tuning_time > 0))
+        return "bandwidth_min and tuning_time must be positive";
+    if (params.bandwidth_min > params.bandwidth_max)
+        return "bandwidth_min exceeds bandwidth_max";
+    return nullptr;
+}
+
+timing::dll_t::dll_t(const ttiming_params_t & params)
+    : F(checked(params).srate / params.fragsize)
+    , B(params.bandwidth)
+    , b(sqrt(8) * M_PI * B / F)
+    , c(b*b/2)
+    , nper(params.fragsize)
+    , tper(params.fragsize / params.srate)
+    , adjustment(params.adjustment)
+    , offset_b(sqrt(8) * M_PI * params.offset_bandwidth / F)
+    , offset_c(offset_b*offset_b/2)
+    , step_threshold(params.step_threshold)
+    , estimator(make_estimator(params.estimator, b, c, 2 * M_PI * B / F,
+                               tper, F, B))
+    , prefilter(*prefilter_mode(params.prefilter), params.outlier_clip, B / F)
+    , auto_bandwidth(params.auto_bandwidth != 0)
+    , omega(2 * M_PI * B / F)
+    , tuner(2 * M_PI * params.bandwidth_min / F,
+            2 * M_PI * params.bandwidth_max / F,
+            1 / (params.tuning_time * F))
+{
+    clock_id(params.clock_source, clock_source);
+    map_to_offset_clock = offset_clock_id(params.offset_clock, offset_clock);
+}
+
+std::pair<double,double> timing::dll_t::process()
+{
+    const double unfiltered_time = get_time(clock_source);
+    if (map_to_offset_clock)
+        filter_offset(bracketed_offset
+                      ([this] {return get_time(clock_source);},
+                       [this] {return get_time(offset_clock);}));
+    return process_at(unfiltered_time);
+}
+
+std::pair<double,double> timing::dll_t::process_at(double unfiltered_time)
+{
+    raw_time = unfiltered_time;
+    filter_time(unfiltered_time);
+    return times();
+}
+
+std::pair<double,double> timing::dll_t::times() const
+{
+    if (n1 == 0U)
+        return {std::numeric_limits<double>::quiet_NaN(),
+                std::numeric_limits<double>::quiet_NaN()};
+    if (map_to_offset_clock)
+        return {epoch + t0 + offset + adjustment,
+                epoch + t1 + offset + offset_drift + adjustment};
+    return {epoch+t0+adjustment, epoch+t1+adjustment};
+}
+
+double timing::dll_t::period() const
+{
+    if (n1 == 0U)
+        return std::numeric_limits<double>::quiet_NaN();
+    return map_to_offset_clock ? t1 - t0 + offset_drift : t1 - t0;
+}
+
+bool timing::dll_t::locked() const
+{
+    return n1 != 0U && n0 * bandwidth() >= nper * F;
+}
+
+double timing::dll_t::time_of(double sample_index) const
+{
+    return times().first + (sample_index - n0) * period() / nper;
+}
+
+double timing::dll_t::sample_at(double time) const
+{
+    return n0 + (time - times().first) * nper / period();
+}
+
+double timing::dll_t::now() const
+{
+    return get_time(map_to_offset_clock ? offset_clock : clock_source);
+}
+
+timing::carry_t timing::dll_t::carry() const
+{
+    return {*this, nper, tper, clock_source, map_to_offset_clock,
+            offset_clock, offset, offset_drift, steps, auto_bandwidth, omega,
+            tuner};
+}
+
+const char * timing::dll_t::check(const carry_t & previous) const
+{
+    if (previous.nper != nper)
+        return "previous loop has another fragsize";
+    if (previous.tper != tper)
+        return "previous loop has another sampling rate";
+    return nullptr;
+}
+
+void timing::dll_t::resume(const carry_t & previous)
+{
+    // Another block size would corrupt the filter state: acquire lock anew
+    if (previous.loop.n1 == 0U || check(previous))
+        return;
+    static_cast<loop_state_t &>(*this) = previous.loop;
+    if (previous.clock_source != clock_source) {
+        // Same loop on another clock: translate by the current offset
+        // between the clocks, the rate difference is followed by the loop
+        const double offset = bracketed_offset
+            ([&] {return get_time(previous.clock_source);},
+             [this] {return get_time(clock_source);});
+        if (std::isfinite(offset))
+            epoch += offset;
+        else
+            n1 = 0U; // unusable clock, acquire lock again
+    }
+    if (map_to_offset_clock && previous.map_to_offset_clock &&
+        offset_clock == previous.offset_clock &&
+        clock_source == previous.clock_source) {
+        offset = previous.offset;
+        offset_drift = previous.offset_drift;
+        steps = previous.steps;
+    }
+    if (n1 == 0U)
+        return;
+    std::visit([&](auto & policy) {policy.resume(*this, tper);}, estimator);
+    if (auto_bandwidth && previous.auto_bandwidth) {
+        // Continue with the noise estimates and the tuned bandwidth
+        const bandwidth_tuner_t bounds = tuner;
+        tuner = previous.tuner;
+        tuner.omega_min = bounds.omega_min;
+        tuner.omega_max = bounds.omega_max;
+        tuner.alpha = bounds.alpha;
+        omega = std::clamp(previous.omega, tuner.omega_min, tuner.omega_max);
+        std::visit([&](auto & policy) {policy.retune(*this, omega, tper);},
+                   estimator);
+    }
+}
+
+double timing::dll_t::filter_time(double unfiltered_time)
+{
+    const double filtered = std::visit([&](auto & policy) {
+        return filter_time_with(policy, prefilter, *this, unfiltered_time,
+                                nper, tper);
+    }, estimator);
+    if (auto_bandwidth) {
+        const double tuned = tuner.process(n0 == 0U ? 0.0 : e, omega);
+        if (tuned != omega) {
+            omega = tuned;
+            std::visit([&](auto & policy) {
+                policy.retune(*this, omega, tper);
+            }, estimator);
+        }
+    }
+    return filtered;
+}
+
+double timing::dll_t::filter_offset(double unfiltered_offset)
+{
+    if (!std::isfinite(unfiltered_offset))
+        return offset;
+    if (!std::isfinite(offset)) {
+        offset = unfiltered_offset;
+        offset_drift = 0.0;
+        return offset;
+    }
+    double predicted = offset + offset_drift;
+    double error = unfiltered_offset - predicted;
+    if (fabs(error) > step_threshold) {
+        // Clock step, e.g. by NTP: absorb it into the offset immediately,
+        // the loop on clock_source is not disturbed.
+        offset = unfiltered_offset;
+        ++steps;
+        return offset;
+    }
+    offset = predicted + offset_b * error;
+    offset_drift += offset_c * error;
+    return offset;
+}
+
+// C API: an instance is a dll_t constructed in the memory of the caller
+
+struct ttiming : timing::dll_t {
+    using timing::dll_t::dll_t;
+};
+
+unsigned ttiming_api_version(void)
+{
+    return TTIMING_API_VERSION;
+}
+
+void ttiming_default_params(ttiming_params_t * params, double srate,
+                            unsigned fragsize)
+{
+    params->srate = srate;
+    params->fragsize = fragsize;
+    params->bandwidth = 19.2 / fragsize;
+    params->clock_source = "CLOCK_REALTIME";
+    params->adjustment = 0.0;
+    params->offset_clock = "none";
+    params->offset_bandwidth = 0.1;
+    params->step_threshold = 2e-3;
+    params->estimator = "dll";
+    params->prefilter = "none";
+    params->outlier_clip = 0.0;
+    params->auto_bandwidth = 0;
+    params->bandwidth_min = 0.02;
+    params->bandwidth_max = 2.0;
+    params->tuning_time = 10.0;
+}
+
+const char * ttiming_check(const ttiming_params_t * params)
+{
+    return timing::dll_t::check(*params);
+}
+
+size_t ttiming_size(void)
+{
+    return sizeof(ttiming);
+}
+
+size_t ttiming_alignment(void)
+{
+    return alignof(ttiming);
+}
+
+ttiming_t * ttiming_init(void * memory, size_t size,
+                         const ttiming_params_t * params)
+{
+    if (memory == nullptr || size < sizeof(ttiming) ||
+        reinterpret_cast<uintptr_t>(memory) % alignof(ttiming) != 0U ||
+        timing::dll_t::check(*params))
+        return nullptr;
+    return new (memory) ttiming(*params);
+}
+
+void ttiming_destroy(ttiming_t * timing)
+{
+    if (timing)
+        timing->~ttiming();
+}
+
+const char * ttiming_resume(ttiming_t * timing, const ttiming_t * previous)
+{
+    const timing::carry_t carried = previous->carry();
+    if (const char * reason = timing->check(carried))
+        return reason;
+    timing->resume(carried);
+    return nullptr;
+}
+
+void ttiming_process(ttiming_t * timing, double * t0, double * t1)
+{
+    const std::pair<double,double> t = timing->process();
+    *t0 = t.first;
+    *t1 = t.second;
+}
+
+void ttiming_process_at(ttiming_t * timing, double measured_time,
+                        double * t0, double * t1)
+{
+    const std::pair<double,double> t = timing->process_at(measured_time);
+    *t0 = t.first;
+    *t1 = t.second;
+}
+
+void ttiming_state(const ttiming_t * timing, ttiming_state_t * state)
+{
+    const std::pair<double,double> t = timing->times();
+    state->t0 = t.first;
+    state->t1 = t.second;
+    state->n0 = timing->n0;
+    state->n1 = timing->n1;
+    state->rate = timing->nper / timing->period();
+    state->bandwidth = timing->bandwidth();
+    state->valid = timing->n1 != 0U;
+}
+
+double ttiming_time_of(const ttiming_t * timing, double sample_index)
+{
+    return timing->time_of(sample_index);
+}
+
+double ttiming_sample_at(const ttiming_t * timing, double time)
+{
+    return timing->sample_at(time);
+}
+
+double ttiming_now(const ttiming_t * timing)
+{
+    return timing->now();
+}
+
+// Local variables:
+// compile-command: "make timing-library"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
@@ -0,0 +1,242 @@
+// Timing core of plugin dll: filters the measured start times of audio
+// blocks with one of the estimators of estimators.hh and maps sample
+// indices to times.  Independent of openMHA and free of allocations, see
+// ttiming.h for the C API of the library built from it.
+
+#ifndef T_TIMING_HH
+#define T_TIMING_HH
+
+#include "ttiming.h"
+#include "estimators.hh"
+#include <limits>
+#include <string_view>
+#include <time.h>
+#include <utility>
+#include <variant>
+
+namespace t::timing {
+
+    /** Translates clock names from the clock_gettime man page to ids.
+     * @return true if the name was recognized */
+    bool clock_id(std::string_view clock_name, clockid_t & clock);
+
+    /** @return current time of the given clock in seconds, NaN on error */
+    double get_time(clockid_t clock);
+
+    /** Measures the offset between two clocks: reads the source clock
+     * before and after the other clock and takes the midpoint, so that a
+     * preemption between the reads is not mistaken for an offset.
+     * Retries when both reads of the source clock are further apart than
+     * max_bracket.
+     * @param source reads the source clock / s
+     * @param other reads the other clock / s
+     * @return other - source, NaN if no bracket was narrow enough */
+    template <class source_clock_t, class other_clock_t>
+    double bracketed_offset(source_clock_t source, other_clock_t other,
+                            double max_bracket = 10e-6,
+                            unsigned attempts = 3U)
+    {
+        for (unsigned attempt = 0; attempt < attempts; ++attempt) {
+            const double before = source();
+            const double reading = other();
+            const double after = source();
+            if (after - before <= max_bracket)
+                return reading - 0.5 * (before + after);
+        }
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+
+    /** State of a running dll that is carried over into a new
+     * configuration when parameters change. */
+    struct carry_t {
+        /** Loop state, n1 == 0 if there is nothing to carry over */
+        loop_state_t loop;
+
+        /** Samples per block and nominal block duration of the loop, only
+         * a dll with the same ones can continue it */
+        uint64_t nper = {0U};
+        double tper = {0.0};
+
+        /** Clock on which the loop ran */
+        clockid_t clock_source;
+
+        /** Offset clock of the dual clock mode, if map_to_offset_clock */
+        bool map_to_offset_clock = {false};
+        clockid_t offset_clock;
+
+        /** State of the offset filter of the dual clock mode */
+        double offset = std::numeric_limits<double>::quiet_NaN();
+        double offset_drift = {0.0};
+        uint64_t steps = {0U};
+
+        /** Tuned normalized bandwidth and noise estimates, if
+         * auto_bandwidth */
+        bool auto_bandwidth = {false};
+        double omega = {0.0};
+        bandwidth_tuner_t tuner;
+    };
+
+    /** Time smoothing filter described in
+        Fons Adriensen: Using a DLL to filter time. 2005.
+        http://kokkinizita.linuxaudio.org/papers/usingdll.pdf
+        or, selected by the estimator parameter, one of the alternative
+        estimators from estimators.hh. */
+    class dll_t : public loop_state_t {
+    public:
+        /** @throw std::invalid_argument with the message of
+         *         ttiming_check() if params are invalid */
+        explicit dll_t(const ttiming_params_t & params);
+        virtual ~dll_t() = default;
+
+        /** @return nullptr if params are valid, otherwise a static
+         * message */
+        static const char * check(const ttiming_params_t & params);
+
+        /** Block update rate / Hz */
+        const double F;
+
+        /** Bandwidth of block update rate */
+        const double B;
+
+        /** 0th order parameter, always 0 */
+        static constexpr double a = 0.0f;
+
+        /** 1st order parameter, sqrt(2)2piB/F */
+        const double b;
+
+        /** 2nd order parameter, (2piB/F)^2 */
+        const double c;
+
+        /** number of samples per block */
+        const uint64_t nper;
+
+        /** nominal duration of 1 block in seconds */
+        const double tper;
+
+        /** Adjustment added to the filtered time stamps (in seconds) */
+        const double adjustment;
+
+        /** which clock clock_gettime should use */
+        clockid_t clock_source;
+
+        /** Whether the filtered times are mapped onto offset_clock */
+        bool map_to_offset_clock = {false};
+
+        /** Clock onto which the filtered times are mapped with a separately
+         * filtered offset, e.g. CLOCK_REALTIME while the loop runs on
+         * CLOCK_MONOTONIC_RAW. */
+        clockid_t offset_clock;
+
+        /** 1st order parameter of the offset filter */
+        const double offset_b;
+
+        /** 2nd order parameter of the offset filter */
+        const double offset_c;
+
+        /** Offset errors larger than this (in seconds) are clock steps */
+        const double step_threshold;
+
+        /** Filtered offset offset_clock - clock_source at block start */
+        double offset = std::numeric_limits<double>::quiet_NaN();
+
+        /** Filtered change of the offset per block (clock slewing) */
+        double offset_drift = {0.0};
+
+        /** Number of clock steps absorbed into the offset */
+        uint64_t steps = {0U};
+
+        /** The selected estimator policy and its private state */
+        std::variant<dll_estimator_t, kalman_estimator_t, rls_estimator_t>
+        estimator;
+
+        /** Robust pre-filter of the measured times */
+        prefilter_t prefilter;
+
+        /** Whether the bandwidth is tuned to the measured noise */
+        const bool auto_bandwidth;
+
+        /** Current normalized bandwidth 2piB/F, starts at the configured
+         * bandwidth and follows the tuner if auto_bandwidth */
+        double omega;
+
+        /** Noise estimates and bounds for auto_bandwidth */
+        bandwidth_tuner_t tuner;
+
+        /** Latest measured time of clock_source, before filtering */
+        double raw_time = std::numeric_limits<double>::quiet_NaN();
+
+        /** @return the current bandwidth in Hz */
+        double bandwidth() const {return omega * F / (2 * M_PI);}
+
+        /** Queries the clock. Invokes filter_offset with the
+         * bracketed_offset of the clocks, skipped for this block if the
+         * thread was preempted during every attempt, and process_at.
+         * @return the filtered start times of this and the next buffer
+         *         in seconds  */
+        virtual std::pair<double,double> process();
+
+        /** Filters a time of clock_source measured by the caller.
+         * @return the filtered start times of this and the next buffer
+         *         in seconds  */
+        virtual std::pair<double,double> process_at(double unfiltered_time);
+
+        /** Filters the input time.  Retunes the estimator if
+         * auto_bandwidth. */
+        virtual double filter_time(double unfiltered_time);
+
+        /** @return the filtered start times of the current and the next
+         * buffer including offset and adjustment, NaN before the first
+         * buffer */
+        std::pair<double,double> times() const;
+
+        /** @return the filtered duration of the current buffer in seconds,
+         * relative to the epoch for full resolution, NaN before the first
+         * buffer */
+        double period() const;
+
+        /** @return true when the loop has run for 1/B seconds since it
+         * acquired lock, long enough to settle */
+        bool locked() const;
+
+        /** @return the filtered time of a total sample index, linear
+         * between the current and the next buffer */
+        double time_of(double sample_index) const;
+
+        /** @return the total sample index at a filtered time */
+        double sample_at(double time) const;
+
+        /** @return the current time of offset_clock, or of clock_source
+         * without offset clock */
+        double now() const;
+
+        /** @return the state to carry over into the next configuration */
+        carry_t carry() const;
+
+        /** @return nullptr if this dll can continue the loop of previous,
+         * otherwise a static message */
+        const char * check(const carry_t & previous) const;
+
+        /** Continues the loop of a previous configuration with the same
+         * signal dimensions instead of acquiring lock again.  If the clock
+         * source differs, the loop state is translated by the current
+         * offset between both clocks.  Must be called before the first
+         * process() of this configuration.
+         * @param previous state of the previous configuration */
+        virtual void resume(const carry_t & previous);
+
+        /** Filters the offset between offset_clock and clock_source with a
+         * slow second order loop.  Steps larger than step_threshold are
+         * taken over immediately.
+         * @return the filtered offset at the start of the current block */
+        virtual double filter_offset(double unfiltered_offset);
+    };
+}
+
+#endif
+
+// Local variables:
+// compile-command: "make timing-library"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
@@ -0,0 +1,166 @@
+// Background part of the tracing facility, built as libttrace.so and
+// linked by all plugins when compiled with "make TRACE=1", so that all
+// plugins of a process share the rings and the flusher thread.
+//
+// Binary file format, all numbers in host byte order:
+//   "TTRACE1" followed by a 0 byte
+//   records, each starting with a one-byte tag:
+//   'C' u64 cycles, u64 ns of CLOCK_MONOTONIC_RAW  -- clock calibration
+//   'N' u32 id, u16 length, length bytes           -- event name
+//   'E' u8 thread, u8 kind, u32 name id, u64 cycles, f64 value
+//   'D' u8 thread, u64 count                        -- dropped events
+
+#include "trace.hh"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace t::trace {
+    std::atomic<bool> enabled = {false};
+    ring_t rings[max_threads];
+}
+
+namespace {
+    using namespace t::trace;
+
+    class flusher_t {
+    public:
+        /** @param filename output file, nullptr: tracing disabled */
+        explicit flusher_t(const char * filename)
+            : file(filename ? fopen(filename, "wb") : nullptr)
+        {
+            if (file == nullptr) {
+                if (filename)
+                    perror(filename);
+                return;
+            }
+            fwrite("TTRACE1", 1, 8, file);
+            calibrate();
+            enabled.store(true, std::memory_order_relaxed);
+            thread = std::thread(&flusher_t::run, this);
+        }
+        ~flusher_t() {
+            if (file == nullptr)
+                return;
+            enabled.store(false, std::memory_order_relaxed);
+            stop = true;
+            thread.join();
+            flush();
+            calibrate();
+            fclose(file);
+        }
+    private:
+        FILE * file;
+        std::atomic<bool> stop = {false};
+        std::thread thread;
+        /** Ids of the names written so far */
+        std::unordered_map<const char *, uint32_t> ids;
+        uint64_t reported_drops[max_threads] = {};
+        /** Head of each ring at the previous flush and the number of
+         * flushes since it last changed */
+        uint64_t previous_heads[max_threads] = {};
+        unsigned idle_flushes[max_threads] = {};
+        /** Flushes without events after which a ring is reclaimed, 1 s */
+        static constexpr unsigned reclaim_flushes = 20U;
+
+        template<class T> void put(T value) {
+            fwrite(&value, sizeof(value), 1, file);
+        }
+        void calibrate() {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+            put('C');
+            put(cycles());
+            put(uint64_t(ts.tv_sec) * 1000000000U + ts.tv_nsec);
+        }
+        uint32_t id(const char * name) {
+            auto found = ids.find(name);
+            if (found != ids.end())
+                return found->second;
+            const uint32_t new_id = ids.size();
+            ids[name] = new_id;
+            const uint16_t length = strnlen(name, 65535U);
+            put('N');
+            put(new_id);
+            put(length);
+            fwrite(name, 1, length, file);
+            return new_id;
+        }
+        void flush() {
+            for (unsigned thread = 0; thread < max_threads; ++thread) {
+                ring_t & ring = rings[thread];
+                const uint64_t head = ring.head.load(std::memory_order_acquire);
+                uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+                for (; tail != head; ++tail) {
+                    const event_t & event = ring.events[tail % ring.capacity];
+                    const uint32_t name_id = id(event.name);
+                    put('E');
+                    put(uint8_t(thread));
+                    put(uint8_t(event.kind));
+                    put(name_id);
+                    put(event.cycles);
+                    put(event.value);
+                }
+                ring.tail.store(tail, std::memory_order_release);
+                const uint64_t dropped =
+                    ring.dropped.load(std::memory_order_relaxed);
+                if (dropped != reported_drops[thread]) {
+                    put('D');
+                    put(uint8_t(thread));
+                    put(dropped - reported_drops[thread]);
+                    reported_drops[thread] = dropped;
+                }
+                reclaim_if_idle(thread, head);
+            }
+        }
+        /** Releases a flushed ring whose owner has not written for
+         * reclaim_flushes flushes, e.g. because the thread has finished.
+         * If the owner writes again, it claims a new ring. */
+        void reclaim_if_idle(unsigned thread, uint64_t head) {
+            ring_t & ring = rings[thread];
+            if (!ring.claimed.load(std::memory_order_acquire) ||
+                head != previous_heads[thread]) {
+                previous_heads[thread] = head;
+                idle_flushes[thread] = 0U;
+                return;
+            }
+            if (++idle_flushes[thread] < reclaim_flushes)
+                return;
+            idle_flushes[thread] = 0U;
+            // Revoke first, then check writing: an owner that announced
+            // its write before sees the revocation or is seen writing
+            const pthread_t owner = ring.owner.exchange(pthread_t());
+            if (ring.writing.load() ||
+                ring.head.load(std::memory_order_acquire) != head) {
+                ring.owner.store(owner);
+                return;
+            }
+            ring.claimed.store(false, std::memory_order_release);
+        }
+        void run() {
+            while (!stop) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                flush();
+                calibrate();
+                fflush(file);
+            }
+        }
+    };
+
+    // Started when libttrace.so is loaded, i.e. before the first plugin
+    // that uses it, stopped when it is unloaded.  Event names are string
+    // literals of the plugins, they are written to the file within 50 ms
+    // of their first use, while the plugin is still loaded.
+    flusher_t flusher(getenv("T_TRACE_FILE"));
+}
+
+// Local variables:
+// compile-command: "make TRACE=1"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
@@ -0,0 +1,143 @@
+// Low-overhead tracing of the processing callbacks of all plugins in this
+// repository.  Compile with -DT_TRACE ("make TRACE=1") to record events,
+// without T_TRACE the macros expand to nothing.  Recording is active when
+// environment variable T_TRACE_FILE names the output file.  Every
+// processing thread writes into its own lock-free ring, a background
+// thread in libttrace.so flushes the rings into a compact binary file,
+// trace2json converts that file for chrome://tracing or ui.perfetto.dev.
+
+#include <atomic>
+#include <cstdint>
+#include <pthread.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace t::trace {
+
+    enum kind_t : uint8_t {ENTER, EXIT, VALUE};
+
+    /** One recorded event.  name points to a string literal. */
+    struct event_t {
+        uint64_t cycles;
+        const char * name;
+        double value;
+        kind_t kind;
+    };
+
+    /** @return a cheap, monotonic cycle count */
+    inline uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#elif defined(__aarch64__)
+        uint64_t count;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(count));
+        return count;
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return uint64_t(ts.tv_sec) * 1000000000U + ts.tv_nsec;
+#endif
+    }
+
+    /** Single-producer single-consumer event ring of one thread. */
+    struct ring_t {
+        static constexpr uint64_t capacity = 4096U;
+        /** True while a thread owns this ring */
+        std::atomic<bool> claimed = {false};
+        /** Thread owning this ring, 0 while it is claimed or reclaimed */
+        std::atomic<pthread_t> owner = {0};
+        /** Set by the owner while it writes, the flusher does not reclaim
+         * the ring then */
+        std::atomic<bool> writing = {false};
+        /** Events written by the owner */
+        alignas(64) std::atomic<uint64_t> head = {0U};
+        /** Events read by the flusher */
+        alignas(64) std::atomic<uint64_t> tail = {0U};
+        /** Events lost because the ring was full */
+        std::atomic<uint64_t> dropped = {0U};
+        event_t events[capacity];
+
+        void push(kind_t kind, const char * name, double value) {
+            const uint64_t h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) >= capacity) {
+                dropped.fetch_add(1U, std::memory_order_relaxed);
+                return;
+            }
+            events[h % capacity] = {cycles(), name, value, kind};
+            head.store(h + 1U, std::memory_order_release);
+        }
+    };
+
+    /** Number of threads that can record at the same time */
+    constexpr unsigned max_threads = 16U;
+
+    /** True if T_TRACE_FILE was set when libttrace.so was loaded */
+    extern std::atomic<bool> enabled;
+
+    extern ring_t rings[max_threads];
+
+    /** @return the ring of the calling thread, claims a free ring without
+     *          locks or allocation on first use, nullptr if none is left.
+     *          Looked up by pthread_self() instead of thread_local
+     *          storage, which would allocate in the audio thread of
+     *          dlopened plugins.  The flusher reclaims rings that stay
+     *          idle, e.g. those of finished threads. */
+    inline ring_t * this_thread_ring() {
+        const pthread_t self = pthread_self();
+        for (ring_t & ring : rings)
+            if (pthread_equal(ring.owner.load(std::memory_order_acquire),
+                              self))
+                return &ring;
+        for (ring_t & ring : rings) {
+            bool expected = false;
+            if (!ring.claimed.load(std::memory_order_relaxed) &&
+                ring.claimed.compare_exchange_strong(expected, true)) {
+                ring.owner.store(self, std::memory_order_release);
+                return &ring;
+            }
+        }
+        return nullptr;
+    }
+
+    inline void record(kind_t kind, const char * name, double value = 0.0) {
+        if (!enabled.load(std::memory_order_relaxed))
+            return;
+        ring_t * ring = this_thread_ring();
+        if (ring == nullptr)
+            return;
+        // Announce the write before checking that the ring is still ours,
+        // the flusher revokes the owner before checking writing
+        ring->writing.store(true);
+        if (pthread_equal(ring->owner.load(), pthread_self()))
+            ring->push(kind, name, value);
+        ring->writing.store(false, std::memory_order_release);
+    }
+
+    /** Records entry on construction and exit on destruction. */
+    class scope_t {
+    public:
+        explicit scope_t(const char * name) : name(name) {record(ENTER, name);}
+        ~scope_t() {record(EXIT, name);}
+    private:
+        const char * name;
+    };
+}
+
+#ifdef T_TRACE
+/** Records entry and exit of the enclosing scope */
+#define T_TRACE_SCOPE(name) t::trace::scope_t t_trace_scope_(name)
+/** Records a named value */
+#define T_TRACE_VALUE(name, value) t::trace::record(t::trace::VALUE, name, value)
+#else
+#define T_TRACE_SCOPE(name) ((void)0)
+#define T_TRACE_VALUE(name, value) ((void)0)
+#endif
+
+// Local variables:
+// compile-command: "make TRACE=1"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
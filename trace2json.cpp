@@ -0,0 +1,135 @@
+// Converts a binary trace file written by libttrace.so (see trace.cpp for
+// the format) into the JSON trace event format that chrome://tracing and
+// https://ui.perfetto.dev display.  Callbacks become duration events per
+// thread, recorded values become counter tracks.
+//
+// Usage: ./trace2json trace.bin > trace.json
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+    struct event_t {
+        uint8_t thread, kind;
+        uint32_t name;
+        uint64_t cycles;
+        double value;
+    };
+
+    template<class T> bool get(FILE * file, T & value) {
+        return fread(&value, sizeof(value), 1, file) == 1;
+    }
+
+    /** Prints s as a JSON string */
+    void print_string(const std::string & s) {
+        putchar('"');
+        for (char c : s) {
+            if (c == '"' || c == '\\')
+                putchar('\\');
+            if (uint8_t(c) >= 0x20)
+                putchar(c);
+        }
+        putchar('"');
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s trace.bin > trace.json\n", argv[0]);
+        return 1;
+    }
+    FILE * file = fopen(argv[1], "rb");
+    char magic[8];
+    if (file == nullptr || fread(magic, 1, 8, file) != 8 ||
+        memcmp(magic, "TTRACE1", 8) != 0) {
+        fprintf(stderr, "%s: not a trace file\n", argv[1]);
+        return 1;
+    }
+    std::unordered_map<uint32_t, std::string> names;
+    std::vector<event_t> events;
+    // first and last clock calibration: cycles and ns
+    uint64_t c0 = 0, n0 = 0, c1 = 0, n1 = 0;
+    bool calibrated = false;
+    uint64_t dropped = 0;
+    for (char tag; get(file, tag);) {
+        if (tag == 'C') {
+            uint64_t cycles, ns;
+            if (!get(file, cycles) || !get(file, ns))
+                break;
+            if (!calibrated) {
+                c0 = cycles;
+                n0 = ns;
+                calibrated = true;
+            }
+            c1 = cycles;
+            n1 = ns;
+        } else if (tag == 'N') {
+            uint32_t id;
+            uint16_t length;
+            if (!get(file, id) || !get(file, length))
+                break;
+            std::string name(length, ' ');
+            if (fread(&name[0], 1, length, file) != length)
+                break;
+            names[id] = name;
+        } else if (tag == 'E') {
+            event_t e;
+            if (!get(file, e.thread) || !get(file, e.kind) ||
+                !get(file, e.name) || !get(file, e.cycles) ||
+                !get(file, e.value))
+                break;
+            events.push_back(e);
+        } else if (tag == 'D') {
+            uint8_t thread;
+            uint64_t count;
+            if (!get(file, thread) || !get(file, count))
+                break;
+            dropped += count;
+        } else {
+            fprintf(stderr, "%s: unknown record '%c'\n", argv[1], tag);
+            return 1;
+        }
+    }
+    fclose(file);
+    if (dropped)
+        fprintf(stderr, "%s: %llu events were dropped\n", argv[1],
+                (unsigned long long)dropped);
+    const double ns_per_cycle =
+        c1 > c0 ? double(n1 - n0) / double(c1 - c0) : 1.0;
+
+    printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first = true;
+    for (const event_t & e : events) {
+        // microseconds since the first calibration
+        const double us = (double(int64_t(e.cycles - c0)) * ns_per_cycle) / 1e3;
+        printf(first ? "" : ",\n");
+        first = false;
+        printf("{\"name\":");
+        print_string(names.count(e.name) ? names[e.name] : "?");
+        switch (e.kind) {
+        case 0:
+        case 1:
+            printf(",\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}",
+                   e.kind == 0 ? 'B' : 'E', unsigned(e.thread), us);
+            break;
+        default:
+            printf(",\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+                   "\"args\":{\"value\":%.17g}}", unsigned(e.thread), us,
+                   e.value);
+        }
+    }
+    printf("\n]}\n");
+    return 0;
+}
+
+// Local variables:
+// compile-command: "make trace2json"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
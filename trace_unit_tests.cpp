@@ -0,0 +1,77 @@
+// Tests of the tracing facility, linked against libttrace.so.  "make
+// trace-tests" runs them with T_TRACE_FILE set and converts the recorded
+// file with trace2json.
+
+#include "trace.hh"
+#include <gmock/gmock.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(trace, idle_rings_are_reclaimed) {
+    ASSERT_TRUE(t::trace::enabled.load()) << "set T_TRACE_FILE";
+    auto claims_ring = [] {
+        bool claimed = false;
+        std::thread([&] {
+            claimed = t::trace::this_thread_ring() != nullptr;
+        }).join();
+        return claimed;
+    };
+    // Threads that keep their rings until all rings are in use
+    std::atomic<bool> done = {false};
+    std::atomic<unsigned> holding = {0U};
+    std::vector<std::thread> holders;
+    for (unsigned k = 0; k < t::trace::max_threads; ++k)
+        holders.emplace_back([&] {
+            if (t::trace::this_thread_ring())
+                ++holding;
+            while (!done)
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        });
+    for (unsigned wait = 0; wait < 100U && holding < t::trace::max_threads;
+         ++wait)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_EQ(t::trace::max_threads, holding.load());
+    EXPECT_FALSE(claims_ring());
+    // The flusher reclaims rings without events for 1 s
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    EXPECT_TRUE(claims_ring());
+    done = true;
+    for (std::thread & holder : holders)
+        holder.join();
+}
+
+TEST(trace, trace2json_converts_recorded_events) {
+    const char * filename = getenv("T_TRACE_FILE");
+    ASSERT_TRUE(filename && t::trace::enabled) << "set T_TRACE_FILE";
+    {
+        t::trace::scope_t scope("trace_test.scope");
+        t::trace::record(t::trace::VALUE, "trace_test.value", 42.5);
+    }
+    // The flusher writes the rings every 50 ms
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    FILE * converted = popen(("./trace2json " + std::string(filename)).c_str(),
+                             "r");
+    ASSERT_NE(nullptr, converted);
+    std::string json;
+    char buffer[4096];
+    for (size_t n; (n = fread(buffer, 1, sizeof(buffer), converted)) > 0;)
+        json.append(buffer, n);
+    EXPECT_EQ(0, pclose(converted));
+    for (const char * event : {"{\"name\":\"trace_test.scope\",\"ph\":\"B\"",
+                               "{\"name\":\"trace_test.scope\",\"ph\":\"E\"",
+                               "{\"name\":\"trace_test.value\",\"ph\":\"C\"",
+                               "\"args\":{\"value\":42.5}"})
+        EXPECT_NE(std::string::npos, json.find(event)) << event;
+}
+
+// Local variables:
+// compile-command: "make trace-tests"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
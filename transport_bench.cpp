@@ -0,0 +1,161 @@
+// Compares latency and CPU cost of the shared memory transport
+// (wav2shm/shm2wav) with the LSL transport (wav2lsl/lsl2wav) on one host.
+// A sender thread publishes one audio block per period, a receiver thread
+// waits for the data.  Every frame carries its send time as time stamp, so
+// the receiver can compute the transport latency.
+//
+// usage: transport-bench [fragsize [channels [srate [blocks]]]]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <time.h>
+#include <lsl_cpp.h>
+#include "shm_ring.hh"
+
+namespace {
+    double now(clockid_t clock = CLOCK_MONOTONIC) {
+        struct timespec ts = {.tv_sec = 0, .tv_nsec = 0};
+        clock_gettime(clock, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+    struct dimensions_t {
+        unsigned fragsize, channels;
+        double srate;
+        unsigned blocks;
+    };
+
+    struct result_t {
+        std::vector<double> latencies;
+        double sender_cpu = 0.0, receiver_cpu = 0.0;
+    };
+
+    /** Sends blocks at the audio rate, calls send(samples, timestamps). */
+    template<class send_t>
+    double sender(const dimensions_t & d, send_t send) {
+        std::vector<float> samples(d.fragsize * d.channels, 0.25f);
+        std::vector<double> timestamps(d.fragsize);
+        const long period_ns = long(1e9 * d.fragsize / d.srate);
+        struct timespec next;
+        clock_gettime(CLOCK_MONOTONIC, &next);
+        double cpu = 0.0;
+        for (unsigned block = 0; block < d.blocks; ++block) {
+            next.tv_nsec += period_ns;
+            while (next.tv_nsec >= 1000000000L) {
+                next.tv_nsec -= 1000000000L;
+                ++next.tv_sec;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+            double cpu0 = now(CLOCK_THREAD_CPUTIME_ID);
+            std::fill(timestamps.begin(), timestamps.end(), now());
+            send(samples.data(), timestamps.data());
+            cpu += now(CLOCK_THREAD_CPUTIME_ID) - cpu0;
+        }
+        return cpu;
+    }
+
+    /** Receives frames with receive(samples, timestamps, max_frames),
+     * which may block for a short time, until all blocks have arrived. */
+    template<class receive_t>
+    void receiver(const dimensions_t & d, receive_t receive, result_t & r) {
+        std::vector<float> samples(d.fragsize * d.channels);
+        std::vector<double> timestamps(d.fragsize);
+        const size_t total = size_t(d.fragsize) * d.blocks;
+        const double deadline = now() + 2.0 + d.blocks * d.fragsize / d.srate;
+        double cpu0 = now(CLOCK_THREAD_CPUTIME_ID);
+        for (size_t received = 0; received < total && now() < deadline;) {
+            size_t frames = receive(samples.data(), timestamps.data(),
+                                    size_t(d.fragsize));
+            if (frames == 0U)
+                continue;
+            r.latencies.push_back(now() - timestamps[frames-1]);
+            received += frames;
+        }
+        r.receiver_cpu = now(CLOCK_THREAD_CPUTIME_ID) - cpu0;
+    }
+
+    result_t bench_shm(const dimensions_t & d) {
+        result_t r;
+        t::shm::ring_t writer("/transport-bench", d.channels, 16 * d.fragsize,
+                              d.srate, true);
+        t::shm::ring_t reader("/transport-bench", d.channels, 0, 0.0, false);
+        uint64_t read_index = reader.write_index();
+        std::thread rx([&]{
+            const struct timespec timeout = {.tv_sec = 0,
+                                             .tv_nsec = 100000000L};
+            receiver(d, [&](float * s, double * ts, size_t n) {
+                reader.wait(read_index, &timeout);
+                return reader.read(s, ts, n, read_index);
+            }, r);
+        });
+        r.sender_cpu = sender(d, [&](const float * s, const double * ts) {
+            writer.write(s, ts, d.fragsize);
+        });
+        rx.join();
+        shm_unlink("/transport-bench");
+        return r;
+    }
+
+    result_t bench_lsl(const dimensions_t & d) {
+        result_t r;
+        lsl::stream_info info("transport-bench", "Audio", d.channels, d.srate,
+                              lsl::cf_float32, "transport-bench");
+        lsl::stream_outlet outlet(info, d.fragsize, 5);
+        auto infos = lsl::resolve_stream("name", "transport-bench", 1, 5.0);
+        if (infos.empty()) {
+            fprintf(stderr, "cannot resolve LSL stream\n");
+            return r;
+        }
+        lsl::stream_inlet inlet(infos[0], 5, d.fragsize);
+        inlet.open_stream(5.0);
+        std::thread rx([&]{
+            receiver(d, [&](float * s, double * ts, size_t n) {
+                return inlet.pull_chunk_multiplexed(s, ts, n * d.channels, n,
+                                                    0.1) / d.channels;
+            }, r);
+        });
+        r.sender_cpu = sender(d, [&](const float * s, const double * ts) {
+            outlet.push_chunk_multiplexed(s, ts, d.fragsize * d.channels);
+        });
+        rx.join();
+        return r;
+    }
+
+    void report(const char * name, const dimensions_t & d, result_t r) {
+        if (r.latencies.empty()) {
+            printf("%-4s no data received\n", name);
+            return;
+        }
+        std::sort(r.latencies.begin(), r.latencies.end());
+        const size_t n = r.latencies.size();
+        printf("%-4s latency/us median %9.1f  p99 %9.1f  max %9.1f"
+               "   cpu/us per block sender %7.2f  receiver %7.2f\n",
+               name, r.latencies[n/2] * 1e6, r.latencies[n*99/100] * 1e6,
+               r.latencies[n-1] * 1e6, r.sender_cpu * 1e6 / d.blocks,
+               r.receiver_cpu * 1e6 / d.blocks);
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    dimensions_t d = {96U, 2U, 48000.0, 5000U};
+    if (argc > 1) d.fragsize = atoi(argv[1]);
+    if (argc > 2) d.channels = atoi(argv[2]);
+    if (argc > 3) d.srate = atof(argv[3]);
+    if (argc > 4) d.blocks = atoi(argv[4]);
+    printf("fragsize %u, channels %u, srate %.0f, %u blocks\n",
+           d.fragsize, d.channels, d.srate, d.blocks);
+    report("shm", d, bench_shm(d));
+    report("lsl", d, bench_lsl(d));
+    return 0;
+}
+
+// Local variables:
+// compile-command: "make transport-bench"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End:
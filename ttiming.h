@@ -0,0 +1,164 @@
+/* C API of the timing core of plugin dll, built as libttiming.a and
+ * libttiming.so ("make timing-library").  Maps audio blocks, and from
+ * them single samples, to filtered times of a system clock, for programs
+ * that drive the sound card without openMHA, e.g. raw ALSA or streaming
+ * daemons.  The library does not depend on openMHA and never allocates:
+ * the caller provides the memory of each instance.  No function blocks,
+ * process functions may be called from the audio thread.  One instance
+ * must not be used by several threads at the same time.
+ *
+ * Usage, once per audio block:
+ *   ttiming_params_t params;
+ *   ttiming_default_params(&params, 48000, 96);
+ *   params.clock_source = "CLOCK_MONOTONIC_RAW";
+ *   void * memory = malloc(ttiming_size());
+ *   ttiming_t * timing = ttiming_init(memory, ttiming_size(), &params);
+ *   ...
+ *   double t0, t1;
+ *   ttiming_process(timing, &t0, &t1);
+ *
+ * The declarations only change in a compatible way while
+ * TTIMING_API_VERSION stays the same. */
+
+#ifndef TTIMING_H
+#define TTIMING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TTIMING_API_VERSION 1
+
+/** One timing instance, lives in memory provided by the caller */
+typedef struct ttiming ttiming_t;
+
+/** Parameters of an instance, same meaning as the parameters of plugin
+ * dll.  Names are compared when the instance is initialized, the strings
+ * are not referenced afterwards. */
+typedef struct ttiming_params {
+    /** Nominal sampling rate / Hz */
+    double srate;
+    /** Samples per block */
+    unsigned fragsize;
+    /** Bandwidth of the loop / Hz */
+    double bandwidth;
+    /** Clock of the measured times, e.g. "CLOCK_MONOTONIC_RAW", see
+     * man clock_gettime */
+    const char * clock_source;
+    /** Added to the filtered times / s */
+    double adjustment;
+    /** Clock onto which the filtered times are mapped with a separately
+     * filtered offset, "none": publish times of clock_source */
+    const char * offset_clock;
+    /** Bandwidth of the offset filter / Hz */
+    double offset_bandwidth;
+    /** Offset changes larger than this are clock steps / s */
+    double step_threshold;
+    /** "dll", "kalman" or "rls" */
+    const char * estimator;
+    /** "none", "pair", "median3" or "median5" */
+    const char * prefilter;
+    /** Clip the loop error to this many standard deviations, 0: off */
+    double outlier_clip;
+    /** Nonzero: tune the bandwidth within bandwidth_min..bandwidth_max */
+    int auto_bandwidth;
+    double bandwidth_min;
+    double bandwidth_max;
+    /** Time constant of the noise estimates of the tuner / s */
+    double tuning_time;
+} ttiming_params_t;
+
+/** Snapshot of the filter state */
+typedef struct ttiming_state {
+    /** Filtered start times of the current and the next block / s */
+    double t0, t1;
+    /** Total sample indices of the first samples of both blocks */
+    uint64_t n0, n1;
+    /** Estimated sampling rate in samples per second of the clock, NaN
+     * before the first block */
+    double rate;
+    /** Current bandwidth of the loop / Hz */
+    double bandwidth;
+    /** Nonzero after the first processed block */
+    int valid;
+} ttiming_state_t;
+
+/** @return TTIMING_API_VERSION of the library */
+unsigned ttiming_api_version(void);
+
+/** Fills params with the defaults of plugin dll: 19.2/fragsize Hz
+ * bandwidth, CLOCK_REALTIME, estimator dll, no pre-filter, no offset
+ * clock, fixed bandwidth. */
+void ttiming_default_params(ttiming_params_t * params, double srate,
+                            unsigned fragsize);
+
+/** @return NULL if params are valid, otherwise a static message */
+const char * ttiming_check(const ttiming_params_t * params);
+
+/** @return bytes of memory needed by one instance */
+size_t ttiming_size(void);
+
+/** @return required alignment of the memory of an instance, not larger
+ * than that of malloc */
+size_t ttiming_alignment(void);
+
+/** Creates an instance in the given memory.  Initialize again after a
+ * restart of the audio stream, e.g. after an xrun, to acquire lock anew.
+ * @return the instance, NULL if params are invalid or the memory is too
+ *         small or misaligned */
+ttiming_t * ttiming_init(void * memory, size_t size,
+                         const ttiming_params_t * params);
+
+/** Ends the life of an instance, the memory can be freed afterwards */
+void ttiming_destroy(ttiming_t * timing);
+
+/** Continues the locked loop of previous, e.g. with other parameters of
+ * the same stream.  Call before the first process of timing.
+ * @return NULL on success, otherwise a static message; timing then
+ *         acquires lock anew because previous has another fragsize or
+ *         sampling rate */
+const char * ttiming_resume(ttiming_t * timing, const ttiming_t * previous);
+
+/** Measures the clock at the start of an audio block and filters it.
+ * Call once per block, at the same point of the audio cycle.
+ * @param t0 filtered start time of this block / s
+ * @param t1 filtered start time of the next block / s */
+void ttiming_process(ttiming_t * timing, double * t0, double * t1);
+
+/** Like ttiming_process, with a time of clock_source measured by the
+ * caller, e.g. from the driver.  The offset clock, if any, is not
+ * measured, the last filtered offset is used. */
+void ttiming_process_at(ttiming_t * timing, double measured_time,
+                        double * t0, double * t1);
+
+/** Fills state with the current filter state */
+void ttiming_state(const ttiming_t * timing, ttiming_state_t * state);
+
+/** @return the filtered time of a total sample index / s, NaN before the
+ * first block */
+double ttiming_time_of(const ttiming_t * timing, double sample_index);
+
+/** @return the total sample index at a time of the published clock,
+ * NaN before the first block */
+double ttiming_sample_at(const ttiming_t * timing, double time);
+
+/** @return current time of the clock of the published times, i.e.
+ * offset_clock, or clock_source without offset clock / s */
+double ttiming_now(const ttiming_t * timing);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/* Local variables:
+ * compile-command: "make timing-library"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * coding: utf-8-unix
+ * End:
+ */
@@ -1,66 +1,103 @@
 #include <memory>
 #include <mha_plugin.hh>
 #include <lsl_cpp.h>
+#include "ac_timebase.hh"
+#include "band_energy.hh"
+#include "trace.hh"
 
 namespace t::plugins::wav2lsl {
 
     /** Runtime configuration class of MHA plugin which publishes the
-        waveform signal as LSL stream outlet */
+        waveform signal, or the band energies of the STFT signal, as LSL
+        stream outlet */
     class cfg_t {
     public:
         /** Constructor
          * @param signal_dimensions fragsize, srate, etc
-         * @param smoothed_time_base_name part of AC variable names where the
-         *        smoothed audio block start times are stored.  "_t0" and "_t1"
-         *        are appended to the base name to access the variables for
-         *        the filtered start times of the current (t0) and the next (t1)
-         *        buffer.
+         * @param smoothed_time_base_name configured name of the dll plugin
+         *        which publishes the smoothed audio block start times, see
+         *        t::plugins::timebase::reader_t
          * @param name Name of the LSL stream to publish
-         * @param lsl_id LSL source id of the LSL stream "device" */
+         * @param lsl_id LSL source id of the LSL stream "device"
+         * @param band_edges edge frequencies of the bands / Hz, empty for
+         *        octave bands, used for STFT signals only
+         * @param frames_per_sample number of STFT frames whose band
+         *        energies are averaged into one LSL sample */
         cfg_t(const mhaconfig_t & signal_dimensions,
               const std::string & smoothed_time_base_name,
               const std::string & name,
               const std::string & lsl_id,
+              const std::vector<float> & band_edges,
+              unsigned frames_per_sample,
               algo_comm_t & ac)
-            : t0_name(smoothed_time_base_name+"_t0")
-            , t1_name(smoothed_time_base_name+"_t1")
-            , lsl_info(name, "Audio", signal_dimensions.channels,
-                       signal_dimensions.srate, lsl::cf_float32, lsl_id)
-            , lsl_outlet(lsl_info, signal_dimensions.fragsize, 5)
+            : timebase(ac, smoothed_time_base_name, signal_dimensions.fragsize)
+            , band_energies(signal_dimensions.domain != MHA_SPECTRUM ? nullptr
+                            : std::make_unique<bands::band_energies_t>
+                            (signal_dimensions, band_edges.empty() ?
+                             bands::band_energies_t::octave_edges
+                             (signal_dimensions.srate) : band_edges))
+            , average(band_energies ? band_energies->energies.size() : 0U,
+                      frames_per_sample)
+            , lsl_info(stream_info(signal_dimensions, name, lsl_id))
+            , lsl_outlet(lsl_info, band_energies ? 1 : signal_dimensions.fragsize,
+                         5)
             , lsl_timestamps(signal_dimensions.fragsize, 0.0)
-            , ac(ac)
+            , window_center(signal_dimensions.fragsize -
+                            signal_dimensions.wndlen / 2.0)
         {
         }
 
         virtual ~cfg_t() = default;
 
       
-        const std::string t0_name, t1_name;
+        timebase::reader_t timebase;
+        /** Band energies of the STFT, nullptr for waveform signals */
+        std::unique_ptr<bands::band_energies_t> band_energies;
+        /** Average of the band energies of frames_per_sample frames */
+        bands::band_average_t average;
         lsl::stream_info lsl_info;
         lsl::stream_outlet lsl_outlet;
         std::vector<double> lsl_timestamps;
-        algo_comm_t & ac;
-        
-        /** Adds metronome beats to input/output signal. */
+        /** Center of the analysis window of an STFT frame relative to the
+         * first sample of the block, in samples */
+        const double window_center;
+
+        /** Publishes the audio samples of the block. */
         virtual void process(mha_wave_t * s) {
             lsl_outlet.push_chunk_multiplexed(s->buf, update_timestamps(),
                                               s->num_frames * s->num_channels);
         }
+        /** Publishes the band energies of frames_per_sample STFT frames,
+         * averaged, as one sample, stamped with the mean time of the
+         * centers of their analysis windows. */
+        virtual void process(mha_spec_t * s) {
+            double t0, dt;
+            timebase.next_block(t0, dt);
+            if (average.add(band_energies->process(*s),
+                            t0 + window_center * dt))
+                lsl_outlet.push_sample(average.mean.data(), average.time);
+        }
         double * update_timestamps() {
-            double t0 = get_ac(t0_name);
-            double dt = (get_ac(t1_name) - t0) / lsl_timestamps.size();
+            double t0, dt;
+            timebase.next_block(t0, dt);
             for (unsigned index = 0; index < lsl_timestamps.size(); ++index)
                 lsl_timestamps[index] = t0 + index * dt;
             return &lsl_timestamps[0];
         }
-        double get_ac(const std::string & name) {
-            if (ac.is_var(name) == false)
-                return std::numeric_limits<double>::quiet_NaN();
-            comm_var_t cv = ac.get_var(name);
-            if (cv.data_type != MHA_AC_DOUBLE || cv.num_entries != 1 ||
-                cv.data == nullptr)
-                return std::numeric_limits<double>::quiet_NaN();
-            return *static_cast<const double*>(cv.data);
+        /** @return LSL stream description: audio with the sampling rate
+         * of the signal, or band energies, band index running fastest,
+         * with the block rate divided by the averaged frames */
+        lsl::stream_info stream_info(const mhaconfig_t & d,
+                                     const std::string & name,
+                                     const std::string & lsl_id) const {
+            if (band_energies)
+                return lsl::stream_info(name, "Energy",
+                                        d.channels * band_energies->bands,
+                                        d.srate / d.fragsize / average.frames,
+                                        lsl::cf_float32,
+                                        lsl_id);
+            return lsl::stream_info(name, "Audio", d.channels, d.srate,
+                                    lsl::cf_float32, lsl_id);
         }
     };
 
@@ -70,7 +107,8 @@ namespace t::plugins::wav2lsl {
         /** Constructor
          * @param algo_comm AC variable space */
         if_t(algo_comm_t & algo_comm, const std::string & /*configured_name*/)
-            : MHAPlugin::plugin_t<cfg_t>("Publishes audio as LSL stream",
+            : MHAPlugin::plugin_t<cfg_t>("Publishes audio, or band energies"
+                                         " of the STFT, as LSL stream",
                                          algo_comm)
         {
             insert_member(dll_plugin_name);
@@ -79,12 +117,26 @@ namespace t::plugins::wav2lsl {
             patchbay.connect(&stream_name.writeaccess, this, &if_t::update);
             insert_member(source_id);
             patchbay.connect(&source_id.writeaccess, this, &if_t::update);
+            insert_member(band_edges);
+            patchbay.connect(&band_edges.writeaccess, this, &if_t::update);
+            insert_member(frames_per_sample);
+            patchbay.connect(&frames_per_sample.writeaccess, this,
+                             &if_t::update);
         }
 
         /** Process callback for processing time domain signal. Input signal
          * is replaced or modified. 
          * @return unmodified pointer to input signal */
         mha_wave_t * process(mha_wave_t * s) {
+            T_TRACE_SCOPE("wav2lsl.process");
+            poll_config()->process(s);
+            return s;
+        }
+        /** Process callback for processing STFT signal.  Input signal is
+         * not modified.
+         * @return unmodified pointer to input signal */
+        mha_spec_t * process(mha_spec_t * s) {
+            T_TRACE_SCOPE("wav2lsl.process");
             poll_config()->process(s);
             return s;
         }
@@ -107,23 +159,38 @@ namespace t::plugins::wav2lsl {
         MHAParser::string_t source_id =
             {"Source ID of the LSL stream device", ""};
 
+        MHAParser::vfloat_t band_edges =
+            {"Edge frequencies of the bands in Hz whose energies are\n"
+             "published when the input is an STFT signal, at most half the\n"
+             "sampling rate.  Empty: octave bands with center frequencies\n"
+             "from 125 Hz to 8 kHz that lie below half the sampling rate",
+             "[]", "[0,]"};
+
+        MHAParser::int_t frames_per_sample =
+            {"Number of STFT frames whose band energies are averaged into\n"
+             "one LSL sample", "1", "[1,]"};
+
         virtual void update(void) {
             if (is_prepared())
                 push_config(new cfg_t(input_cfg(),
                                       dll_plugin_name.data,
                                       stream_name.data,
                                       source_id.data,
+                                      band_edges.data,
+                                      frames_per_sample.data,
                                       ac));
         }
     };
 }
 
 MHAPLUGIN_CALLBACKS(wav2lsl,t::plugins::wav2lsl::if_t,wave,wave)
+MHAPLUGIN_PROC_CALLBACK(wav2lsl,t::plugins::wav2lsl::if_t,spec,spec)
 
 MHAPLUGIN_DOCUMENTATION\
 (wav2lsl,
  "data-sinks time",
- "Publishes the time domain audio signal as LSL stream"
+ "Publishes the time domain audio signal, or the band energies of the"
+ " STFT signal, as LSL stream"
  )
 
 // Local variables:
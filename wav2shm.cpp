@@ -0,0 +1,141 @@
+#include <memory>
+#include <mha_plugin.hh>
+#include "ac_timebase.hh"
+#include "shm_ring.hh"
+#include "trace.hh"
+
+namespace t::plugins::wav2shm {
+
+    /** Runtime configuration class of MHA plugin which publishes the
+        waveform signal into a shared memory ring buffer */
+    class cfg_t {
+    public:
+        /** Constructor
+         * @param signal_dimensions fragsize, srate, etc
+         * @param smoothed_time_base_name configured name of the dll plugin
+         *        which publishes the smoothed audio block start times, see
+         *        t::plugins::timebase::reader_t
+         * @param ring Shared memory ring, owned by if_t */
+        cfg_t(const mhaconfig_t & signal_dimensions,
+              const std::string & smoothed_time_base_name,
+              shm::ring_t & ring,
+              algo_comm_t & ac)
+            : timebase(ac, smoothed_time_base_name, signal_dimensions.fragsize)
+            , ring(ring)
+            , timestamps(signal_dimensions.fragsize, 0.0)
+        {
+        }
+
+        virtual ~cfg_t() = default;
+
+        timebase::reader_t timebase;
+        shm::ring_t & ring;
+        std::vector<double> timestamps;
+
+        /** Creates the writing end of the ring.
+         * @param name Name of the shared memory segment, starting with '/'
+         * @param blocks Capacity of the ring buffer in audio blocks */
+        static std::unique_ptr<shm::ring_t>
+        create_ring(const mhaconfig_t & d, const std::string & name,
+                    unsigned blocks) {
+            try {
+                return std::make_unique<shm::ring_t>
+                    (name, d.channels, d.fragsize * blocks, d.srate, true);
+            } catch (std::exception & e) {
+                throw MHA_Error(__FILE__, __LINE__, "%s", e.what());
+            }
+        }
+
+        /** Copies the audio block with its time stamps into the ring. */
+        virtual void process(mha_wave_t * s) {
+            ring.write(s->buf, update_timestamps(), s->num_frames);
+        }
+        double * update_timestamps() {
+            double t0, dt;
+            timebase.next_block(t0, dt);
+            for (unsigned index = 0; index < timestamps.size(); ++index)
+                timestamps[index] = t0 + index * dt;
+            return &timestamps[0];
+        }
+    };
+
+    class if_t : public MHAPlugin::plugin_t<cfg_t> 
+    {
+    public:
+        /** Constructor
+         * @param algo_comm AC variable space */
+        if_t(algo_comm_t & algo_comm, const std::string & /*configured_name*/)
+            : MHAPlugin::plugin_t<cfg_t>("Publishes audio into shared memory"
+                                         " for processes on the same host",
+                                         algo_comm)
+        {
+            insert_member(dll_plugin_name);
+            patchbay.connect(&dll_plugin_name.writeaccess, this, &if_t::update);
+            insert_member(shm_name);
+            insert_member(blocks);
+        }
+
+        /** Process callback for processing time domain signal.
+         * @return unmodified pointer to input signal */
+        mha_wave_t * process(mha_wave_t * s) {
+            T_TRACE_SCOPE("wav2shm.process");
+            poll_config()->process(s);
+            return s;
+        }
+        /** Prepare for signal processing: creates the ring. */
+        void prepare(mhaconfig_t & signal_dimensions) {
+            ring = cfg_t::create_ring(signal_dimensions, shm_name.data,
+                                      blocks.data);
+            update();
+        }
+        /** Removes the ring. */
+        void release() {
+            ring.reset();
+        }
+
+        /** Ring buffer, created by prepare() only, so that it is never
+         * replaced or resized while a configuration writes to it */
+        std::unique_ptr<shm::ring_t> ring;
+
+        /** Connects configuration events to actions. */
+        MHAEvents::patchbay_t<if_t> patchbay;
+
+        MHAParser::string_t dll_plugin_name =
+            {"Name of dll plugin name to access filtered block times", "dll"};
+
+        MHAParser::string_t shm_name =
+            {"Name of the POSIX shared memory segment to publish,"
+             " must start with '/'.\nTakes effect at the next prepare",
+             "/wav2shm"};
+
+        MHAParser::int_t blocks =
+            {"Capacity of the shared memory ring buffer in audio blocks.\n"
+             "Takes effect at the next prepare", "16", "[2,]"};
+
+        virtual void update(void) {
+            if (is_prepared())
+                push_config(new cfg_t(input_cfg(),
+                                      dll_plugin_name.data,
+                                      *ring,
+                                      ac));
+        }
+    };
+}
+
+MHAPLUGIN_CALLBACKS(wav2shm,t::plugins::wav2shm::if_t,wave,wave)
+
+MHAPLUGIN_DOCUMENTATION\
+(wav2shm,
+ "data-sinks time",
+ "Publishes the time domain audio signal together with the filtered time"
+ " stamps of a dll plugin in a lock-free shared memory ring buffer."
+ " Receivers on the same host, e.g. plugin shm2wav in another openMHA"
+ " process, read from this ring without network stack or serialization."
+ )
+
+// Local variables:
+// compile-command: "make"
+// c-basic-offset: 4
+// indent-tabs-mode: nil
+// coding: utf-8-unix
+// End: